@@ -1,5 +1,11 @@
 # pragma once
 # include <memory>
+# include <cstdlib>
+# include <cstddef>
+# include <new>
+# include <mutex>
+# include <type_traits>
+# include <algorithm>
 
 template<typename AllocStrategy>
 class CAllocatedOn
@@ -42,4 +48,169 @@ public:
     {
         ::operator delete(ptr);
     }
-};
\ No newline at end of file
+};
+
+// Slots of one size carved from chunks, the free ones linked through
+// themselves. Chunks are never returned. Not synchronized.
+class FixedPool
+{
+public:
+    FixedPool(size_t size, size_t align):
+        size_(roundUp(std::max(size, sizeof(FreeSlot)), std::max(align, alignof(FreeSlot)))),
+        free_(nullptr), bump_(nullptr), end_(nullptr) {}
+
+    FixedPool(const FixedPool &other) = delete;
+
+    FixedPool& operator=(const FixedPool &other) = delete;
+
+    void* alloc()
+    {
+        if (free_ != nullptr)
+        {
+            FreeSlot *slot = free_;
+            free_ = slot->next;
+            return slot;
+        }
+        if (static_cast<size_t>(end_ - bump_) < size_)
+            grow();
+        void *result = bump_;
+        bump_ += size_;
+        return result;
+    }
+
+    void free(void *ptr)
+    {
+        free_ = new(ptr) FreeSlot{free_};
+    }
+
+    bool hasRoom() const
+    {
+        return free_ != nullptr || static_cast<size_t>(end_ - bump_) >= size_;
+    }
+
+    // Moves every slot this pool could still hand out to other.
+    void moveFreeTo(FixedPool &other)
+    {
+        for (; static_cast<size_t>(end_ - bump_) >= size_; bump_ += size_)
+            free(bump_);
+        if (free_ == nullptr)
+            return;
+        FreeSlot *last = free_;
+        while (last->next != nullptr)
+            last = last->next;
+        last->next = other.free_;
+        other.free_ = free_;
+        free_ = nullptr;
+    }
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    struct FreeSlot
+    {
+        FreeSlot *next;
+    };
+
+    const size_t size_;
+    FreeSlot *free_;
+    char *bump_, *end_;
+
+    static size_t roundUp(size_t size, size_t align)
+    {
+        return (size + align - 1) / align * align;
+    }
+
+    void grow()
+    {
+        size_t bytes = (size_ > CHUNK_SIZE ? size_ : CHUNK_SIZE);
+        bump_ = static_cast<char*>(std::malloc(bytes));
+        if (bump_ == nullptr)
+            throw std::bad_alloc();
+        end_ = bump_ + bytes;
+    }
+};
+
+// For classes allocated by the million, every instance in a slot of a pool
+// of their own: class Node : public CAllocatedOn<PoolStrategy<Node> >.
+// By default every thread has a pool and refills it from the slots of exited
+// threads; an object freed on another thread joins the pool of that thread.
+// Without ThreadLocal there is one pool behind a mutex, which keeps the slots
+// of objects that are mostly freed on other threads in one place.
+// Only sizeof(T) is served, so a larger derived class needs its own strategy.
+template<typename T, bool ThreadLocal = true>
+class PoolStrategy
+{
+public:
+    static void* Alloc(size_t count)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not pooled");
+        if (count > sizeof(T))
+            throw std::bad_alloc();
+        if (ThreadLocal && !exited())
+        {
+            FixedPool &pool = local().pool;
+            if (!pool.hasRoom())
+            {
+                std::lock_guard<std::mutex> lock(shared().mutex);
+                shared().pool.moveFreeTo(pool);
+            }
+            return pool.alloc();
+        }
+        std::lock_guard<std::mutex> lock(shared().mutex);
+        return shared().pool.alloc();
+    }
+
+    static void Free(void *ptr)
+    {
+        if (ThreadLocal && !exited())
+        {
+            local().pool.free(ptr);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(shared().mutex);
+        shared().pool.free(ptr);
+    }
+private:
+    struct SharedPool
+    {
+        std::mutex mutex;
+        FixedPool pool;
+
+        SharedPool() : pool(sizeof(T), alignof(T)) {}
+    };
+
+    struct LocalPool
+    {
+        FixedPool pool;
+
+        LocalPool() : pool(sizeof(T), alignof(T)) {}
+
+        ~LocalPool()
+        {
+            std::lock_guard<std::mutex> lock(shared().mutex);
+            pool.moveFreeTo(shared().pool);
+            exited() = true;
+        }
+    };
+
+    // Never destroyed, objects may be deleted during static destruction.
+    static SharedPool& shared()
+    {
+        static typename std::aligned_storage<sizeof(SharedPool), alignof(SharedPool)>::type storage;
+        static SharedPool *pool = new(&storage) SharedPool();
+        return *pool;
+    }
+
+    static LocalPool& local()
+    {
+        static thread_local LocalPool pool;
+        return pool;
+    }
+
+    // Frees can still arrive from destructors of other thread_local objects
+    // after the pool of the thread is gone. They then go to the shared pool.
+    static bool& exited()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+};
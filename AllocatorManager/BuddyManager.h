@@ -0,0 +1,197 @@
+# pragma once
+# include "MemoryManager.h"
+# include "SizeClasses.h"
+# include <cstddef>
+# include <cstdint>
+# include <new>
+# include <mutex>
+# include <utility>
+# include <sys/mman.h>
+
+// A binary buddy system over one region reserved up front. Blocks are powers
+// of two; a block is split in halves to serve a smaller request and merged
+// with its buddy as soon as both are free, so free memory does not stay cut
+// up after the blocks around it are gone. Free blocks of RELEASE_ORDER and
+// more give their pages back to the system.
+// The order of every block is kept in a table beside the region, one byte per
+// MIN_ORDER block, so the blocks themselves carry no header.
+class BuddyManager : public IMemoryManager
+{
+public:
+    static const size_t MIN_ORDER = 6;
+    static const size_t RELEASE_ORDER = 20;
+
+    // capacity is rounded up to a power of two and only reserved: pages are
+    // taken when first touched.
+    explicit BuddyManager(size_t capacity = size_t(1) << 28, bool headerless = true):
+        IMemoryManager(headerless), max_order_(orderOf(capacity)), nonempty_(0), allocated_(0)
+    {
+        base_ = static_cast<char*>(SlabMemory::map(this->capacity(), this));
+        void *states = mmap(nullptr, this->capacity() >> MIN_ORDER, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (states == MAP_FAILED)
+        {
+            SlabMemory::unmap(base_, this->capacity());
+            throw std::bad_alloc();
+        }
+        states_ = static_cast<uint8_t*>(states);
+        for (size_t order = 0; order < 64; ++order)
+        {
+            heads_[order] = nullptr;
+            counts_[order] = 0;
+        }
+        push(base_, max_order_);
+    }
+
+    BuddyManager(const BuddyManager &other) = delete;
+
+    BuddyManager& operator=(const BuddyManager &other) = delete;
+
+    ~BuddyManager()
+    {
+        munmap(states_, capacity() >> MIN_ORDER);
+        SlabMemory::unmap(base_, capacity());
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        if (size > capacity())
+            return nullptr;
+        size_t order = orderOf(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t candidates = nonempty_ & (~uint64_t(0) << order);
+        if (candidates == 0)
+            return nullptr;
+        size_t found = __builtin_ctzll(candidates);
+        char *block = reinterpret_cast<char*>(heads_[found]);
+        remove(block, found);
+        while (found > order)
+        {
+            --found;
+            push(block + (size_t(1) << found), found);
+        }
+        state(block) = USED | order;
+        allocated_ += size_t(1) << order;
+        return block;
+    }
+
+    // Blocks are aligned to their size, and the region to a slab.
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        if (align > SlabMemory::SLAB_SIZE)
+            throw std::bad_alloc();
+        return Alloc(size < align ? align : size);
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        char *block = static_cast<char*>(ptr);
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t order = state(block) & ORDER_MASK;
+        allocated_ -= size_t(1) << order;
+        for (; order < max_order_; ++order)
+        {
+            char *buddy = base_ + ((block - base_) ^ (size_t(1) << order));
+            if (state(buddy) != (FREE | order))
+                break;
+            remove(buddy, order);
+            // The upper half is no longer the head of a block.
+            if (buddy < block)
+                std::swap(block, buddy);
+            state(buddy) = 0;
+        }
+        push(block, order);
+        if (order >= RELEASE_ORDER)
+            madvise(block + SlabMemory::OS_PAGE_SIZE, (size_t(1) << order) - SlabMemory::OS_PAGE_SIZE, MADV_DONTNEED);
+    }
+
+    size_t capacity() const
+    {
+        return size_t(1) << max_order_;
+    }
+
+    // Bytes in allocated blocks, including what rounding to powers of two adds.
+    size_t allocated() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocated_;
+    }
+
+    size_t largestFree() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return largest();
+    }
+
+    // External fragmentation as seen by requests of size: the share of the
+    // free memory that lies in blocks too small to serve one.
+    double fragmentation(size_t size) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t free = capacity() - allocated_, unusable = 0;
+        for (size_t order = MIN_ORDER; order < orderOf(size) && order <= max_order_; ++order)
+            unusable += counts_[order] << order;
+        return (free == 0 ? 0.0 : static_cast<double>(unusable) / free);
+    }
+private:
+    static const uint8_t ORDER_MASK = 0x3f;
+    static const uint8_t FREE = 0x40;
+    static const uint8_t USED = 0x80;
+
+    struct FreeBlock
+    {
+        FreeBlock *prev, *next;
+    };
+
+    const size_t max_order_;
+    char *base_;
+    uint8_t *states_;
+    mutable std::mutex mutex_;
+    FreeBlock *heads_[64];
+    size_t counts_[64];
+    // Bit k is set when there is a free block of order k.
+    uint64_t nonempty_;
+    size_t allocated_;
+
+    static size_t orderOf(size_t size)
+    {
+        if (size <= (size_t(1) << MIN_ORDER))
+            return MIN_ORDER;
+        return 64 - __builtin_clzll(size - 1);
+    }
+
+    size_t largest() const
+    {
+        return (nonempty_ == 0 ? 0 : size_t(1) << (63 - __builtin_clzll(nonempty_)));
+    }
+
+    uint8_t& state(const char *block)
+    {
+        return states_[(block - base_) >> MIN_ORDER];
+    }
+
+    void push(char *block, size_t order)
+    {
+        FreeBlock *free = new(block) FreeBlock{nullptr, heads_[order]};
+        if (free->next != nullptr)
+            free->next->prev = free;
+        heads_[order] = free;
+        ++counts_[order];
+        nonempty_ |= uint64_t(1) << order;
+        state(block) = FREE | order;
+    }
+
+    void remove(char *block, size_t order)
+    {
+        FreeBlock *free = reinterpret_cast<FreeBlock*>(block);
+        if (free->prev != nullptr)
+            free->prev->next = free->next;
+        else
+            heads_[order] = free->next;
+        if (free->next != nullptr)
+            free->next->prev = free->prev;
+        --counts_[order];
+        if (heads_[order] == nullptr)
+            nonempty_ &= ~(uint64_t(1) << order);
+    }
+};
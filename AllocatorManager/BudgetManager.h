@@ -0,0 +1,178 @@
+# pragma once
+# include "MemoryManager.h"
+# include <cstddef>
+# include <cstdint>
+# include <new>
+# include <atomic>
+# include <functional>
+# include <stdexcept>
+
+// Lets a subsystem take at most limit bytes from an inner manager. When a
+// request does not fit, the pressure handler, if any, is called with the
+// bytes missing and may free memory, say flush a cache; the request is tried
+// again once. What still does not fit goes to the fallback manager, or fails
+// when there is none, which operator new turns into std::bad_alloc.
+// Every block carries its size and origin in a prefix, so that unsized frees
+// from operator delete are accounted as exactly as sized ones. Neither
+// manager may be headerless: operator delete would skip the budget.
+class BudgetManager : public IMemoryManager
+{
+public:
+    BudgetManager(IMemoryManager *inner, size_t limit, IMemoryManager *fallback = nullptr):
+        inner_(inner), fallback_(fallback), limit_(limit), used_(0), peak_(0), fallback_used_(0)
+    {
+        if (inner->Headerless() || (fallback != nullptr && fallback->Headerless()))
+            throw std::invalid_argument("BudgetManager can not wrap a headerless manager");
+    }
+
+    BudgetManager(const BudgetManager &other) = delete;
+
+    BudgetManager& operator=(const BudgetManager &other) = delete;
+
+    // Not thread safe, to be set before the manager is used. The handler
+    // is not called again for allocations it makes itself.
+    void onPressure(std::function<void(size_t)> handler)
+    {
+        handler_ = std::move(handler);
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        return Alloc(size, alignof(std::max_align_t));
+    }
+
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        size_t offset = offsetOf(align);
+        size_t bytes = size + offset;
+        IMemoryManager *target = inner_;
+        if (!reserve(bytes))
+        {
+            relieve(bytes);
+            if (!reserve(bytes))
+            {
+                if (fallback_ == nullptr)
+                    return nullptr;
+                target = fallback_;
+            }
+        }
+        char *raw = static_cast<char*>(align == alignof(std::max_align_t) ? target->Alloc(bytes) :
+                                       target->Alloc(bytes, align));
+        if (raw == nullptr)
+        {
+            if (target == inner_)
+                used_.fetch_sub(bytes, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if (target == fallback_)
+            fallback_used_.fetch_add(bytes, std::memory_order_relaxed);
+        new(raw + offset - sizeof(Prefix)) Prefix{bytes, static_cast<uint32_t>(offset), target == fallback_};
+        return raw + offset;
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        char *data = static_cast<char*>(ptr);
+        const Prefix *prefix = reinterpret_cast<const Prefix*>(data) - 1;
+        size_t bytes = prefix->bytes;
+        size_t offset = prefix->offset;
+        IMemoryManager *target = inner_;
+        if (prefix->fallback != 0)
+        {
+            target = fallback_;
+            fallback_used_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        else
+        {
+            used_.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        if (offset == PREFIX_SIZE)
+            target->Free(data - offset, bytes);
+        else
+            target->Free(data - offset);
+    }
+
+    size_t limit() const
+    {
+        return limit_;
+    }
+
+    // Bytes taken from the inner manager, prefixes included.
+    size_t used() const
+    {
+        return used_.load(std::memory_order_relaxed);
+    }
+
+    size_t peak() const
+    {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+    // Bytes taken from the fallback manager over the limit.
+    size_t fallbackUsed() const
+    {
+        return fallback_used_.load(std::memory_order_relaxed);
+    }
+private:
+    // Right before the memory handed out. bytes is all that was asked from
+    // the manager the block came from.
+    struct Prefix
+    {
+        size_t bytes;
+        uint32_t offset;
+        uint32_t fallback;
+    };
+
+    static const size_t PREFIX_SIZE = alignof(std::max_align_t);
+
+    IMemoryManager *inner_, *fallback_;
+    const size_t limit_;
+    std::atomic<size_t> used_, peak_, fallback_used_;
+    std::function<void(size_t)> handler_;
+
+    static size_t offsetOf(size_t align)
+    {
+        return (align > PREFIX_SIZE ? align : PREFIX_SIZE);
+    }
+
+    // Set while the handler runs on this thread.
+    static bool& relieving()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    bool reserve(size_t bytes)
+    {
+        size_t used = used_.load(std::memory_order_relaxed);
+        do
+        {
+            if (bytes > limit_ || used > limit_ - bytes)
+                return false;
+        }
+        while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+        size_t peak = peak_.load(std::memory_order_relaxed);
+        while (used + bytes > peak && !peak_.compare_exchange_weak(peak, used + bytes, std::memory_order_relaxed)) {}
+        return true;
+    }
+
+    void relieve(size_t bytes)
+    {
+        if (!handler_ || relieving())
+            return;
+        size_t used = used_.load(std::memory_order_relaxed);
+        if (used + bytes <= limit_)
+            return;
+        relieving() = true;
+        try
+        {
+            handler_(used + bytes - limit_);
+        }
+        catch (...)
+        {
+            relieving() = false;
+            throw;
+        }
+        relieving() = false;
+    }
+};
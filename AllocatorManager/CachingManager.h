@@ -0,0 +1,377 @@
+# pragma once
+# include "MemoryManager.h"
+# include "SizeClasses.h"
+# include <cstdlib>
+# include <cstddef>
+# include <new>
+# include <atomic>
+# include <mutex>
+
+// A manager shared by all threads, each installing it with its own
+// CMemoryManagerSwitcher. Every thread keeps a free list per size class, and
+// only takes the lock of a class to move a whole batch between its list and
+// the central transfer cache. Memory freed on another thread simply joins that
+// thread's lists and travels back in batches. Slabs are never returned before
+// the manager and every thread that used it are gone.
+// Headerless by default, as SlabManager.
+class CachingManager : public IMemoryManager
+{
+public:
+    explicit CachingManager(bool headerless = true):
+        IMemoryManager(headerless), id_(nextId()), central_(Central::create(this)) {}
+
+    CachingManager(const CachingManager &other) = delete;
+
+    CachingManager& operator=(const CachingManager &other) = delete;
+
+    ~CachingManager()
+    {
+        central_->release();
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        if (size > SizeClasses::MAX_SIZE)
+            return allocLarge(size, SizeClasses::GRANULARITY);
+        return allocSlot(SizeClasses::classOf(size));
+    }
+
+    // Alignments up to half a slab.
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        if (align <= SizeClasses::GRANULARITY)
+            return Alloc(size);
+        if (align >= SlabMemory::SLAB_SIZE)
+            throw std::bad_alloc();
+        size_t cls = SizeClasses::classOf(size, align);
+        if (cls == SizeClasses::NUM)
+            return allocLarge(size, align);
+        return allocSlot(cls);
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        Slab *slab = SlabMemory::headerOf<Slab>(ptr);
+        if (slab->cls == LARGE)
+        {
+            SlabMemory::unmap(slab, slab->bytes);
+            return;
+        }
+        freeSlot(slab->cls, ptr);
+    }
+
+    // Small sizes never touch the slab header.
+    virtual void Free(void *ptr, size_t size) override
+    {
+        if (size > SizeClasses::MAX_SIZE)
+            Free(ptr);
+        else
+            freeSlot(SizeClasses::classOf(size), ptr);
+    }
+private:
+    static const size_t LARGE = SizeClasses::NUM;
+
+    struct FreeSlot
+    {
+        FreeSlot *next;
+        // Only used by the first slot of a batch in the transfer cache.
+        FreeSlot *next_batch;
+    };
+
+    struct FreeList
+    {
+        FreeSlot *head;
+        size_t count;
+    };
+
+    struct Slab
+    {
+        size_t cls;
+        size_t bytes;
+        Slab *next;
+    };
+
+    static const size_t HEADER_SIZE = SizeClasses::headerSize(sizeof(Slab));
+
+    // Moves between a thread and the central cache are this many slots.
+    static size_t batchSize(size_t cls)
+    {
+        size_t batch = 4096 / SizeClasses::classSize(cls);
+        return (batch < 2 ? 2 : (batch > 32 ? 32 : batch));
+    }
+
+    // Reference counted, so that it outlives the manager until the last
+    // thread holding a cache of it has exited.
+    class Central
+    {
+    public:
+        static Central* create(IMemoryManager *owner)
+        {
+            void *mem = std::malloc(sizeof(Central));
+            if (mem == nullptr)
+                throw std::bad_alloc();
+            return new(mem) Central(owner);
+        }
+
+        void addReference()
+        {
+            refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release()
+        {
+            if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            this->~Central();
+            std::free(this);
+        }
+
+        // Refills an empty thread list with a batch.
+        void fetch(size_t cls, FreeList &list)
+        {
+            size_t batch = batchSize(cls);
+            std::lock_guard<std::mutex> lock(classes_[cls].mutex);
+            Class &central = classes_[cls];
+            if (central.transfer != nullptr)
+            {
+                list.head = central.transfer;
+                list.count = batch;
+                central.transfer = central.transfer->next_batch;
+                return;
+            }
+            list.count = 0;
+            list.head = nullptr;
+            while (list.count < batch && central.loose != nullptr)
+            {
+                FreeSlot *slot = central.loose;
+                central.loose = slot->next;
+                slot->next = list.head;
+                list.head = slot;
+                ++list.count;
+            }
+            for (; list.count < batch; ++list.count)
+            {
+                FreeSlot *slot = carve(cls, central);
+                slot->next = list.head;
+                list.head = slot;
+            }
+        }
+
+        // Moves a batch from the head of a thread list to the transfer cache.
+        void release(size_t cls, FreeList &list, size_t batch)
+        {
+            FreeSlot *first = list.head, *last = first;
+            for (size_t i = 1; i < batch; ++i)
+                last = last->next;
+            list.head = last->next;
+            list.count -= batch;
+            last->next = nullptr;
+            std::lock_guard<std::mutex> lock(classes_[cls].mutex);
+            first->next_batch = classes_[cls].transfer;
+            classes_[cls].transfer = first;
+        }
+
+        // Gives back what is left of a thread list when the thread exits.
+        void releaseAll(size_t cls, FreeList &list)
+        {
+            size_t batch = batchSize(cls);
+            while (list.count >= batch)
+                release(cls, list, batch);
+            while (list.head != nullptr)
+            {
+                FreeSlot *slot = list.head;
+                list.head = slot->next;
+                freeOne(cls, slot);
+            }
+            list.count = 0;
+        }
+
+        void* allocOne(size_t cls)
+        {
+            FreeList list = {nullptr, 0};
+            fetch(cls, list);
+            FreeSlot *slot = list.head;
+            list.head = slot->next;
+            --list.count;
+            releaseAll(cls, list);
+            return slot;
+        }
+
+        void freeOne(size_t cls, FreeSlot *slot)
+        {
+            std::lock_guard<std::mutex> lock(classes_[cls].mutex);
+            slot->next = classes_[cls].loose;
+            classes_[cls].loose = slot;
+        }
+    private:
+        struct Class
+        {
+            std::mutex mutex;
+            FreeSlot *transfer;
+            FreeSlot *loose;
+            char *bump, *end;
+        };
+
+        // Only registered in PageMap with the slabs; the manager may be gone
+        // by the time the last of them is unmapped.
+        IMemoryManager *const owner_;
+        std::atomic<size_t> refs_;
+        std::atomic<Slab*> slabs_;
+        Class classes_[SizeClasses::NUM];
+
+        explicit Central(IMemoryManager *owner) : owner_(owner), refs_(1), slabs_(nullptr)
+        {
+            for (Class &central : classes_)
+            {
+                central.transfer = central.loose = nullptr;
+                central.bump = central.end = nullptr;
+            }
+        }
+
+        ~Central()
+        {
+            Slab *slab = slabs_.load(std::memory_order_acquire);
+            while (slab != nullptr)
+            {
+                Slab *next = slab->next;
+                SlabMemory::unmap(slab, slab->bytes);
+                slab = next;
+            }
+        }
+
+        FreeSlot* carve(size_t cls, Class &central)
+        {
+            size_t size = SizeClasses::classSize(cls);
+            if (central.bump == nullptr || central.bump + size > central.end)
+            {
+                char *begin = static_cast<char*>(SlabMemory::map(SlabMemory::SLAB_SIZE, owner_));
+                Slab *slab = new(begin) Slab{cls, SlabMemory::SLAB_SIZE, slabs_.load(std::memory_order_relaxed)};
+                while (!slabs_.compare_exchange_weak(slab->next, slab, std::memory_order_release,
+                                                     std::memory_order_relaxed)) {}
+                central.bump = begin + HEADER_SIZE;
+                central.end = begin + SlabMemory::SLAB_SIZE;
+            }
+            FreeSlot *slot = reinterpret_cast<FreeSlot*>(central.bump);
+            central.bump += size;
+            return slot;
+        }
+    };
+
+    struct ThreadCache
+    {
+        size_t id;
+        Central *central;
+        ThreadCache *next;
+        FreeList lists[SizeClasses::NUM];
+    };
+
+    // The caches of one thread, one per manager it touched. They are flushed
+    // to the central caches when the thread exits.
+    struct ThreadCaches
+    {
+        size_t last_id;
+        ThreadCache *last;
+        ThreadCache *head;
+
+        ~ThreadCaches()
+        {
+            while (head != nullptr)
+            {
+                ThreadCache *next = head->next;
+                for (size_t cls = 0; cls < SizeClasses::NUM; ++cls)
+                    head->central->releaseAll(cls, head->lists[cls]);
+                head->central->release();
+                std::free(head);
+                head = next;
+            }
+            exited() = true;
+        }
+    };
+
+    const size_t id_;
+    Central *central_;
+
+    void* allocSlot(size_t cls)
+    {
+        ThreadCache *cache = localCache();
+        if (cache == nullptr)
+            return central_->allocOne(cls);
+        FreeList &list = cache->lists[cls];
+        if (list.head == nullptr)
+            central_->fetch(cls, list);
+        FreeSlot *slot = list.head;
+        list.head = slot->next;
+        --list.count;
+        return slot;
+    }
+
+    void freeSlot(size_t cls, void *ptr)
+    {
+        FreeSlot *slot = new(ptr) FreeSlot{nullptr, nullptr};
+        ThreadCache *cache = localCache();
+        if (cache == nullptr)
+        {
+            central_->freeOne(cls, slot);
+            return;
+        }
+        FreeList &list = cache->lists[cls];
+        slot->next = list.head;
+        list.head = slot;
+        ++list.count;
+        if (list.count > 2 * batchSize(cls))
+            central_->release(cls, list, batchSize(cls));
+    }
+
+    // Frees can still arrive from destructors of other thread_local objects
+    // after the caches are gone. They then go straight to the central cache.
+    static bool& exited()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    ThreadCache* localCache()
+    {
+        if (exited())
+            return nullptr;
+        static thread_local ThreadCaches caches = {0, nullptr, nullptr};
+        if (caches.last_id == id_)
+            return caches.last;
+        ThreadCache *cache = caches.head;
+        while (cache != nullptr && cache->id != id_)
+            cache = cache->next;
+        if (cache == nullptr)
+        {
+            cache = static_cast<ThreadCache*>(std::malloc(sizeof(ThreadCache)));
+            if (cache == nullptr)
+                throw std::bad_alloc();
+            cache->id = id_;
+            cache->central = central_;
+            cache->next = caches.head;
+            for (FreeList &list : cache->lists)
+                list = FreeList{nullptr, 0};
+            central_->addReference();
+            caches.head = cache;
+        }
+        caches.last_id = id_;
+        caches.last = cache;
+        return cache;
+    }
+
+    void* allocLarge(size_t size, size_t align)
+    {
+        size_t offset = (align > HEADER_SIZE ? align : HEADER_SIZE);
+        size_t bytes = SlabMemory::roundSize(offset + size);
+        char *begin = static_cast<char*>(SlabMemory::map(bytes, this));
+        new(begin) Slab{LARGE, bytes, nullptr};
+        return begin + offset;
+    }
+
+    // Identifiers are never reused, unlike addresses, so a thread can not
+    // mistake a new manager for a dead one it has a cache of.
+    static size_t nextId()
+    {
+        static std::atomic<size_t> last_id(0);
+        return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+};
@@ -1,32 +1,331 @@
 # include "MemoryManager.h"
+# include <sys/mman.h>
+# ifdef MEMORY_MANAGER_STATIC
+# include MEMORY_MANAGER_STATIC_HEADER
+# include <typeinfo>
+# endif
 
-CMemoryManagerSwitcher *CMemoryManagerSwitcher::top_ = nullptr;
-size_t CMemoryManagerSwitcher::align_ = std::max(alignof(std::max_align_t), sizeof(IMemoryManager*));
+thread_local CMemoryManagerSwitcher *CMemoryManagerSwitcher::top_ = nullptr;
+size_t CMemoryManagerSwitcher::align_ = std::max(alignof(std::max_align_t), sizeof(Header));
+std::atomic<PageMap::Leaf*> PageMap::root_[size_t(1) << PageMap::ROOT_BITS];
 
-void* operator new(size_t count)
+PageMap::Leaf* PageMap::leaf(size_t index, bool create)
 {
-    IMemoryManager *curr;
-    if (CMemoryManagerSwitcher::top_ == nullptr)
-        curr = nullptr;
-    else
-        curr = CMemoryManagerSwitcher::top_->curr_;
+    Leaf *leaf = root_[index].load(std::memory_order_acquire);
+    if (leaf != nullptr || !create)
+        return leaf;
+    // Fresh anonymous pages are zeroed, which is a leaf with no owners.
+    void *mem = mmap(nullptr, sizeof(Leaf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::bad_alloc();
+    Leaf *fresh = static_cast<Leaf*>(mem);
+    if (root_[index].compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+        return fresh;
+    munmap(mem, sizeof(Leaf));
+    return leaf;
+}
+
+uintptr_t OwnerTag::of(const IMemoryManager *manager)
+{
+    uintptr_t owner = reinterpret_cast<uintptr_t>(manager);
+# ifdef MEMORY_MANAGER_STATIC
+    if (manager != nullptr && typeid(*manager) == typeid(MEMORY_MANAGER_STATIC))
+        owner |= STATIC;
+# endif
+    return owner;
+}
+
+void PageMap::set(void *begin, size_t bytes, IMemoryManager *owner)
+{
+    uintptr_t tag = OwnerTag::of(owner);
+    uintptr_t first = reinterpret_cast<uintptr_t>(begin) >> CHUNK_BITS;
+    uintptr_t last = (reinterpret_cast<uintptr_t>(begin) + bytes - 1) >> CHUNK_BITS;
+    if (last >> (ROOT_BITS + LEAF_BITS) != 0)
+        throw std::bad_alloc();
+    for (uintptr_t chunk = first; chunk <= last; ++chunk)
+    {
+        Leaf *owners = leaf(chunk >> LEAF_BITS, owner != nullptr);
+        if (owners != nullptr)
+            owners->owners[chunk & (LEAF_SIZE - 1)].store(tag, std::memory_order_release);
+    }
+}
+
+namespace
+{
+    // Calls Manager's own functions, so that for a concrete type the compiler
+    // sees the callee and can inline it. An overload Manager hides is replaced
+    // by what the default of IMemoryManager would end up calling.
+    template<typename Manager>
+    struct Direct
+    {
+        static void* alloc(IMemoryManager *manager, size_t size)
+        {
+            return static_cast<Manager*>(manager)->Manager::Alloc(size);
+        }
+
+        static void* alloc(IMemoryManager *manager, size_t size, size_t align)
+        {
+            return alignedAlloc(static_cast<Manager*>(manager), size, align, 0);
+        }
+
+        static void free(IMemoryManager *manager, void *ptr)
+        {
+            static_cast<Manager*>(manager)->Manager::Free(ptr);
+        }
+
+        static void free(IMemoryManager *manager, void *ptr, size_t size)
+        {
+            sizedFree(static_cast<Manager*>(manager), ptr, size, 0);
+        }
+    private:
+        template<typename M>
+        static auto alignedAlloc(M *manager, size_t size, size_t align, int) ->
+            decltype(manager->M::Alloc(size, align))
+        {
+            return manager->M::Alloc(size, align);
+        }
+
+        template<typename M>
+        static void* alignedAlloc(M *manager, size_t size, size_t align, long)
+        {
+            return manager->IMemoryManager::Alloc(size, align);
+        }
+
+        template<typename M>
+        static auto sizedFree(M *manager, void *ptr, size_t size, int) ->
+            decltype(manager->M::Free(ptr, size))
+        {
+            manager->M::Free(ptr, size);
+        }
+
+        template<typename M>
+        static void sizedFree(M *manager, void *ptr, size_t, long)
+        {
+            manager->M::Free(ptr);
+        }
+    };
+
+    template<>
+    struct Direct<IMemoryManager>
+    {
+        static void* alloc(IMemoryManager *manager, size_t size)
+        {
+            return manager->Alloc(size);
+        }
+
+        static void* alloc(IMemoryManager *manager, size_t size, size_t align)
+        {
+            return manager->Alloc(size, align);
+        }
+
+        static void free(IMemoryManager *manager, void *ptr)
+        {
+            manager->Free(ptr);
+        }
+
+        static void free(IMemoryManager *manager, void *ptr, size_t size)
+        {
+            manager->Free(ptr, size);
+        }
+    };
+}
+
+void* CMemoryManagerSwitcher::withHeader(void *mem, uintptr_t owner, size_t align)
+{
+    if (mem == nullptr)
+        throw std::bad_alloc();
+    uintptr_t data = (reinterpret_cast<uintptr_t>(mem) + align_ + align - 1) & ~uintptr_t(align - 1);
+    new(reinterpret_cast<Header*>(data) - 1) Header{owner, mem};
+    return reinterpret_cast<void*>(data);
+}
+
+template<typename Manager>
+void* CMemoryManagerSwitcher::allocate(IMemoryManager *curr, size_t count, size_t align)
+{
+    if (!curr->Headerless())
+        return withHeader(Direct<Manager>::alloc(curr, count + padding(align)), OwnerTag::of(curr), align);
     void *mem;
-    if (curr == nullptr)
-        mem = std::malloc(CMemoryManagerSwitcher::align_ + count);
+    if (align == DEFAULT_ALIGN)
+        mem = Direct<Manager>::alloc(curr, count);
     else
-        mem = curr->Alloc(CMemoryManagerSwitcher::align_ + count);
-    uintptr_t alloc_mem(reinterpret_cast<uintptr_t>(curr));
-    new(mem) uintptr_t(alloc_mem);
-    return static_cast<char*>(mem) + CMemoryManagerSwitcher::align_;
+        mem = Direct<Manager>::alloc(curr, count, align);
+    if (mem == nullptr)
+        throw std::bad_alloc();
+    return mem;
 }
 
-void operator delete(void *ptr) noexcept
+template<typename Manager>
+void CMemoryManagerSwitcher::release(uintptr_t owner, void *ptr, size_t size)
+{
+    if (size == 0)
+        Direct<Manager>::free(OwnerTag::manager(owner), ptr);
+    else
+        Direct<Manager>::free(OwnerTag::manager(owner), ptr, size);
+}
+
+void* CMemoryManagerSwitcher::Allocate(size_t count, size_t align)
+{
+    if (align < DEFAULT_ALIGN)
+        align = DEFAULT_ALIGN;
+    if (top_ == nullptr || top_->curr_ == nullptr)
+        return withHeader(std::malloc(count + padding(align)), 0, align);
+# ifdef MEMORY_MANAGER_STATIC
+    if (top_->static_)
+        return allocate<MEMORY_MANAGER_STATIC>(top_->curr_, count, align);
+# endif
+    return allocate<IMemoryManager>(top_->curr_, count, align);
+}
+
+// Sized frees of over-aligned headerless memory stay unsized: the manager
+// picked a size class for the alignment, not for the size.
+void CMemoryManagerSwitcher::Deallocate(void *ptr, size_t size, size_t align) noexcept
 {
-    void *mem = static_cast<char*>(ptr) - CMemoryManagerSwitcher::align_;
-    uintptr_t *alloc_mem = static_cast<uintptr_t*>(mem);
-    IMemoryManager *alloc = reinterpret_cast<IMemoryManager*>(*alloc_mem);
-    if (alloc == nullptr)
-        std::free(mem);
+    if (ptr == nullptr)
+        return;
+    if (align < DEFAULT_ALIGN)
+        align = DEFAULT_ALIGN;
+    uintptr_t owner = PageMap::find(ptr);
+    if (owner != 0)
+    {
+        if (align != DEFAULT_ALIGN)
+            size = 0;
+    }
     else
-        alloc->Free(mem);
-}
\ No newline at end of file
+    {
+        Header *header = static_cast<Header*>(ptr) - 1;
+        owner = header->owner;
+        ptr = header->raw;
+        if (owner == 0)
+        {
+            std::free(ptr);
+            return;
+        }
+        if (size != 0)
+            size += padding(align);
+    }
+# ifdef MEMORY_MANAGER_STATIC
+    if (OwnerTag::isStatic(owner))
+    {
+        release<MEMORY_MANAGER_STATIC>(owner, ptr, size);
+        return;
+    }
+# endif
+    release<IMemoryManager>(owner, ptr, size);
+}
+
+void* operator new(size_t count)
+{
+    return CMemoryManagerSwitcher::Allocate(count, 0);
+}
+
+void* operator new[](size_t count)
+{
+    return CMemoryManagerSwitcher::Allocate(count, 0);
+}
+
+void* operator new(size_t count, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return CMemoryManagerSwitcher::Allocate(count, 0);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t count, const std::nothrow_t &tag) noexcept
+{
+    return operator new(count, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, 0);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, 0);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, size, 0);
+}
+
+void operator delete[](void *ptr, size_t size) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, size, 0);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, 0);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, 0);
+}
+
+// Before C++17 over-aligned types can only get what operator new(size_t) gives.
+# ifdef __cpp_aligned_new
+void* operator new(size_t count, std::align_val_t align)
+{
+    return CMemoryManagerSwitcher::Allocate(count, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t count, std::align_val_t align)
+{
+    return CMemoryManagerSwitcher::Allocate(count, static_cast<size_t>(align));
+}
+
+void* operator new(size_t count, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return CMemoryManagerSwitcher::Allocate(count, static_cast<size_t>(align));
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t count, std::align_val_t align, const std::nothrow_t &tag) noexcept
+{
+    return operator new(count, align, tag);
+}
+
+void operator delete(void *ptr, std::align_val_t align) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, static_cast<size_t>(align));
+}
+
+void operator delete[](void *ptr, std::align_val_t align) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, static_cast<size_t>(align));
+}
+
+void operator delete(void *ptr, size_t size, std::align_val_t align) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, size, static_cast<size_t>(align));
+}
+
+void operator delete[](void *ptr, size_t size, std::align_val_t align) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, size, static_cast<size_t>(align));
+}
+
+void operator delete(void *ptr, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, static_cast<size_t>(align));
+}
+
+void operator delete[](void *ptr, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    CMemoryManagerSwitcher::Deallocate(ptr, 0, static_cast<size_t>(align));
+}
+# endif
@@ -2,16 +2,112 @@
 # include "AllocatorStrategy.h"
 # include <cstdlib>
 # include <new>
+# include <algorithm>
 # include <memory>
 # include <cstddef>
+# include <cstdint>
+# include <atomic>
 
+// A headerless manager registers all its memory in PageMap, so operator new
+// hands out its blocks as they are, without the header naming the manager.
+// Its memory must therefore reach operator new only through the manager
+// itself, never through another manager wrapping it.
 class IMemoryManager
 {
 public:
+    explicit IMemoryManager(bool headerless = false) : headerless_(headerless) {}
+
     virtual void* Alloc(size_t size) = 0;
     virtual void Free(void *ptr) = 0;
 
+    // The default only serves alignments up to that of std::max_align_t.
+    virtual void* Alloc(size_t size, size_t align)
+    {
+        if (align > alignof(std::max_align_t))
+            throw std::bad_alloc();
+        return Alloc(size);
+    }
+
+    // size is the one the memory was allocated with, so that a manager can
+    // find the size class without looking at the memory.
+    virtual void Free(void *ptr, size_t /*size*/)
+    {
+        Free(ptr);
+    }
+
+    bool Headerless() const
+    {
+        return headerless_;
+    }
+
     virtual ~IMemoryManager() = default;
+private:
+    const bool headerless_;
+};
+
+// Built with -DMEMORY_MANAGER_STATIC=Manager and
+// -DMEMORY_MANAGER_STATIC_HEADER='"Manager.h"', operator new and delete call
+// the functions of that very type directly, not through the vtable, whenever
+// it is the installed manager or the owner of the memory. Derived types still
+// go through the vtable.
+// The owner of a block, as operator delete finds it, is the address of its
+// manager, with STATIC set when the manager is of that type.
+class OwnerTag
+{
+public:
+    static const uintptr_t STATIC = 1;
+
+    // 0 for no manager.
+    static uintptr_t of(const IMemoryManager *manager);
+
+    static IMemoryManager* manager(uintptr_t owner)
+    {
+        return reinterpret_cast<IMemoryManager*>(owner & ~STATIC);
+    }
+
+    static bool isStatic(uintptr_t owner)
+    {
+        return (owner & STATIC) != 0;
+    }
+};
+
+// A two level radix tree from every CHUNK_SIZE-aligned chunk of the address
+// space to the OwnerTag of the manager owning it. Leaves are mapped when first needed and
+// never freed, a leaf covers a gigabyte.
+class PageMap
+{
+public:
+    static const size_t CHUNK_BITS = 16;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+
+    // begin must be CHUNK_SIZE-aligned. A null owner unregisters the chunks.
+    static void set(void *begin, size_t bytes, IMemoryManager *owner);
+
+    // 0 if no manager owns ptr.
+    static uintptr_t find(const void *ptr)
+    {
+        uintptr_t chunk = reinterpret_cast<uintptr_t>(ptr) >> CHUNK_BITS;
+        if (chunk >> (ROOT_BITS + LEAF_BITS) != 0)
+            return 0;
+        Leaf *leaf = root_[chunk >> LEAF_BITS].load(std::memory_order_acquire);
+        if (leaf == nullptr)
+            return 0;
+        return leaf->owners[chunk & (LEAF_SIZE - 1)].load(std::memory_order_relaxed);
+    }
+private:
+    static const size_t ADDRESS_BITS = 48;
+    static const size_t LEAF_BITS = 14;
+    static const size_t LEAF_SIZE = size_t(1) << LEAF_BITS;
+    static const size_t ROOT_BITS = ADDRESS_BITS - CHUNK_BITS - LEAF_BITS;
+
+    struct Leaf
+    {
+        std::atomic<uintptr_t> owners[LEAF_SIZE];
+    };
+
+    static std::atomic<Leaf*> root_[size_t(1) << ROOT_BITS];
+
+    static Leaf* leaf(size_t index, bool create);
 };
 
 class DefaultManager : public IMemoryManager
@@ -26,18 +122,21 @@ public:
     {
         std::free(ptr);
     }
-};
 
-void* operator new(size_t count);
-void operator delete(void *ptr) noexcept;
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        void *mem;
+        if (posix_memalign(&mem, std::max(align, sizeof(void*)), size) != 0)
+            return nullptr;
+        return mem;
+    }
+};
 
 class CMemoryManagerSwitcher
 {
 public:
-    friend void* operator new(size_t count);
-    friend void operator delete(void *ptr) noexcept;
-
-    explicit CMemoryManagerSwitcher(IMemoryManager *alloc) : curr_(alloc), prev_(top_)
+    explicit CMemoryManagerSwitcher(IMemoryManager *alloc):
+        curr_(alloc), prev_(top_), static_(OwnerTag::isStatic(OwnerTag::of(alloc)))
     {
         top_ = this;
     }
@@ -48,9 +147,44 @@ public:
         curr_ = nullptr;
         prev_ = nullptr;
     }
+
+    // The whole family of global operators new and delete comes down to these.
+    // size 0 is an unsized delete.
+    static void* Allocate(size_t count, size_t align);
+    static void Deallocate(void *ptr, size_t size, size_t align) noexcept;
 private:
+    static const size_t DEFAULT_ALIGN = alignof(std::max_align_t);
+
+    // Precedes the memory handed out for a manager that is not headerless.
+    // raw is the block the manager gave, it differs from the header address
+    // for over-aligned memory.
+    struct Header
+    {
+        uintptr_t owner;
+        void *raw;
+    };
+
     IMemoryManager *curr_;
     CMemoryManagerSwitcher *prev_;
-    static CMemoryManagerSwitcher *top_;
+    bool static_;
+    // Every thread has its own stack of switchers; memory allocated on one
+    // thread and freed on another still goes back to the manager recorded in
+    // its header.
+    static thread_local CMemoryManagerSwitcher *top_;
     static size_t align_;
-};
\ No newline at end of file
+
+    // What is allocated on top of count for the header and the alignment.
+    static size_t padding(size_t align)
+    {
+        return align_ + align - DEFAULT_ALIGN;
+    }
+
+    // Manager is either MEMORY_MANAGER_STATIC or IMemoryManager.
+    template<typename Manager>
+    static void* allocate(IMemoryManager *curr, size_t count, size_t align);
+
+    template<typename Manager>
+    static void release(uintptr_t owner, void *ptr, size_t size);
+
+    static void* withHeader(void *mem, uintptr_t owner, size_t align);
+};
@@ -0,0 +1,155 @@
+# pragma once
+# include "MemoryManager.h"
+# include "StackAllocator.h"
+# include <cstddef>
+# include <cassert>
+# include <new>
+# include <memory_resource>
+
+// Adapters between the managers and std::pmr (C++17), so that a standard
+// container can take its memory from a manager with no operator new
+// installed, and a pmr resource can be installed like any manager.
+
+// Any manager as a memory_resource. Over-aligned blocks are freed unsized, as
+// a manager may have served them from a larger class.
+class ManagerResource : public std::pmr::memory_resource
+{
+public:
+    explicit ManagerResource(IMemoryManager *manager) : manager_(manager) {}
+
+    IMemoryManager* manager() const
+    {
+        return manager_;
+    }
+private:
+    IMemoryManager *manager_;
+
+    virtual void* do_allocate(size_t bytes, size_t align) override
+    {
+        void *result = manager_->Alloc(bytes, align);
+        if (result == nullptr)
+            throw std::bad_alloc();
+        return result;
+    }
+
+    virtual void do_deallocate(void *ptr, size_t bytes, size_t align) override
+    {
+        if (align > alignof(std::max_align_t))
+            manager_->Free(ptr);
+        else
+            manager_->Free(ptr, bytes);
+    }
+
+    virtual bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        const ManagerResource *resource = dynamic_cast<const ManagerResource*>(&other);
+        return resource != nullptr && resource->manager_ == manager_;
+    }
+};
+
+// The arena as a monotonic resource: deallocation does nothing, release()
+// drops everything allocated through the resource since it was made. It
+// shares the blocks of the allocator, so the usual markers and ArenaScope
+// keep working around it; release() must be nested in them like a marker.
+class StackResource : public std::pmr::memory_resource
+{
+public:
+    explicit StackResource(manager::StackAllocator &arena) : arena_(arena), start_(arena.mark()) {}
+
+    StackResource(const StackResource &other) = delete;
+
+    StackResource& operator=(const StackResource &other) = delete;
+
+    void release()
+    {
+        arena_.rewind(start_);
+    }
+
+    manager::StackAllocator& arena() const
+    {
+        return arena_;
+    }
+private:
+    manager::StackAllocator &arena_;
+    manager::StackAllocator::Marker start_;
+
+    virtual void* do_allocate(size_t bytes, size_t align) override
+    {
+        return arena_.Alloc(bytes, align);
+    }
+
+    virtual void do_deallocate(void *, size_t, size_t) override {}
+
+    virtual bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+// A memory_resource as a manager. deallocate() wants the size and alignment
+// back, so they are kept in a header in front of the block.
+// Installed with CMemoryManagerSwitcher, the resource must not get its own
+// memory from operator new: neither it nor its upstream may be
+// new_delete_resource, the default, or allocating recurses until the stack
+// overflows. Debug builds check this for the standard resources.
+class ResourceManager : public IMemoryManager
+{
+public:
+    explicit ResourceManager(std::pmr::memory_resource *resource) : resource_(resource)
+    {
+        assert(resource != std::pmr::new_delete_resource());
+        assert(upstreamOf(resource) != std::pmr::new_delete_resource());
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        return Alloc(size, alignof(std::max_align_t));
+    }
+
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        size_t offset = offsetOf(align);
+        char *raw = static_cast<char*>(resource_->allocate(size + offset, align));
+        new(raw + offset - sizeof(Header)) Header{size + offset, align};
+        return raw + offset;
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        char *data = static_cast<char*>(ptr);
+        const Header *header = reinterpret_cast<const Header*>(data - sizeof(Header));
+        resource_->deallocate(data - offsetOf(header->align), header->bytes, header->align);
+    }
+
+    std::pmr::memory_resource* resource() const
+    {
+        return resource_;
+    }
+private:
+    struct Header
+    {
+        size_t bytes;
+        size_t align;
+    };
+
+    static const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+    std::pmr::memory_resource *resource_;
+
+    static size_t offsetOf(size_t align)
+    {
+        return (align > HEADER_SIZE ? align : HEADER_SIZE);
+    }
+
+    // Of the standard resources that have one, nullptr for the rest.
+    static std::pmr::memory_resource* upstreamOf(std::pmr::memory_resource *resource)
+    {
+        if (auto pool = dynamic_cast<std::pmr::unsynchronized_pool_resource*>(resource))
+            return pool->upstream_resource();
+        if (auto pool = dynamic_cast<std::pmr::synchronized_pool_resource*>(resource))
+            return pool->upstream_resource();
+        if (auto monotonic = dynamic_cast<std::pmr::monotonic_buffer_resource*>(resource))
+            return monotonic->upstream_resource();
+        return nullptr;
+    }
+};
@@ -0,0 +1,233 @@
+# pragma once
+# include "MemoryManager.h"
+# include <cstddef>
+# include <cstdint>
+# include <cmath>
+# include <new>
+# include <atomic>
+# include <mutex>
+# include <random>
+# include <map>
+# include <unordered_map>
+# include <vector>
+# include <fstream>
+# include <ostream>
+# include <stdexcept>
+# include <execinfo.h>
+
+// Wraps another manager and counts what goes through it: allocations, frees,
+// live bytes and their peak, and a histogram of sizes by powers of two. On
+// average one allocation per sample_bytes allocated has its call stack taken,
+// intervals being drawn at random as pprof expects; the rest only pay for a
+// few atomic additions. dumpHeap() writes the stacks in the legacy heap
+// format `pprof` reads.
+// The wrapped manager must not be headerless: operator delete would find it
+// in PageMap and skip the profiler.
+class ProfilingManager : public IMemoryManager
+{
+public:
+    static const size_t MAX_DEPTH = 64;
+    static const size_t SIZE_CLASSES = 65;
+
+    struct Stats
+    {
+        size_t allocs, frees;
+        size_t live_bytes, peak_bytes;
+        // Class k counts sizes of k bits, from 2^(k-1) to 2^k - 1.
+        size_t histogram[SIZE_CLASSES];
+    };
+
+    explicit ProfilingManager(IMemoryManager *inner, size_t sample_bytes = 512 << 10):
+        inner_(inner), sample_bytes_(sample_bytes), allocs_(0), frees_(0), live_(0), peak_(0),
+        until_sample_(0), gen_(42)
+    {
+        if (inner->Headerless())
+            throw std::invalid_argument("ProfilingManager can not wrap a headerless manager");
+        for (size_t i = 0; i < SIZE_CLASSES; ++i)
+            histogram_[i] = 0;
+        until_sample_ = nextInterval();
+    }
+
+    ProfilingManager(const ProfilingManager &other) = delete;
+
+    ProfilingManager& operator=(const ProfilingManager &other) = delete;
+
+    virtual void* Alloc(size_t size) override
+    {
+        return Alloc(size, alignof(std::max_align_t));
+    }
+
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        size_t offset = offsetOf(align);
+        char *raw = static_cast<char*>(align == alignof(std::max_align_t) ? inner_->Alloc(size + offset) :
+                                       inner_->Alloc(size + offset, align));
+        if (raw == nullptr)
+            return nullptr;
+        Prefix *prefix = new(raw + offset - sizeof(Prefix)) Prefix{size, static_cast<uint32_t>(offset), 0};
+        count(size);
+        long long left = until_sample_.fetch_sub(size, std::memory_order_relaxed) - static_cast<long long>(size);
+        if (left <= 0)
+            sample(raw + offset, prefix);
+        return raw + offset;
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        char *data = static_cast<char*>(ptr);
+        Prefix *prefix = reinterpret_cast<Prefix*>(data) - 1;
+        if (prefix->sampled != 0)
+            unsample(data, prefix->size);
+        frees_.fetch_add(1, std::memory_order_relaxed);
+        live_.fetch_sub(prefix->size, std::memory_order_relaxed);
+        size_t bytes = prefix->size + prefix->offset;
+        if (prefix->offset == PREFIX_SIZE)
+            inner_->Free(data - prefix->offset, bytes);
+        else
+            inner_->Free(data - prefix->offset);
+    }
+
+    Stats stats() const
+    {
+        Stats result;
+        result.allocs = allocs_.load(std::memory_order_relaxed);
+        result.frees = frees_.load(std::memory_order_relaxed);
+        result.live_bytes = live_.load(std::memory_order_relaxed);
+        result.peak_bytes = peak_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < SIZE_CLASSES; ++i)
+            result.histogram[i] = histogram_[i].load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // The counters and the histogram, one line each.
+    void dumpText(std::ostream &out) const
+    {
+        CMemoryManagerSwitcher bypass(nullptr);
+        Stats current = stats();
+        out << "allocations: " << current.allocs << "\nfrees: " << current.frees
+            << "\nlive bytes: " << current.live_bytes << "\npeak bytes: " << current.peak_bytes << '\n';
+        for (size_t i = 0; i < SIZE_CLASSES; ++i)
+            if (current.histogram[i] != 0)
+                out << "sizes below " << (i < 64 ? uint64_t(1) << i : ~uint64_t(0)) << ": "
+                    << current.histogram[i] << '\n';
+    }
+
+    // Sampled stacks, live and since the start, followed by the mappings of
+    // the process so that pprof can symbolize them:
+    //     pprof --text ./binary profile.heap
+    void dumpHeap(std::ostream &out) const
+    {
+        CMemoryManagerSwitcher bypass(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Bucket total = {0, 0, 0, 0};
+            for (const auto &bucket : buckets_)
+            {
+                total.live_count += bucket.second.live_count;
+                total.live_bytes += bucket.second.live_bytes;
+                total.alloc_count += bucket.second.alloc_count;
+                total.alloc_bytes += bucket.second.alloc_bytes;
+            }
+            out << "heap profile: ";
+            writeCounts(out, total);
+            out << " @ heap_v2/" << sample_bytes_ << '\n';
+            for (const auto &bucket : buckets_)
+            {
+                writeCounts(out, bucket.second);
+                out << " @";
+                for (void *frame : bucket.first)
+                    out << " 0x" << std::hex << reinterpret_cast<uintptr_t>(frame) << std::dec;
+                out << '\n';
+            }
+        }
+        out << "\nMAPPED_LIBRARIES:\n";
+        std::ifstream maps("/proc/self/maps");
+        out << maps.rdbuf();
+    }
+private:
+    // Right before the memory handed out.
+    struct Prefix
+    {
+        size_t size;
+        uint32_t offset;
+        uint32_t sampled;
+    };
+
+    struct Bucket
+    {
+        size_t live_count, live_bytes;
+        size_t alloc_count, alloc_bytes;
+    };
+
+    static const size_t PREFIX_SIZE = alignof(std::max_align_t);
+
+    IMemoryManager *inner_;
+    const size_t sample_bytes_;
+    std::atomic<size_t> allocs_, frees_;
+    std::atomic<size_t> live_, peak_;
+    std::atomic<size_t> histogram_[SIZE_CLASSES];
+    std::atomic<long long> until_sample_;
+    // The rest is only touched with the mutex held and operator new going to
+    // malloc, so that the profiler does not profile itself.
+    mutable std::mutex mutex_;
+    std::minstd_rand gen_;
+    std::map<std::vector<void*>, Bucket> buckets_;
+    std::unordered_map<void*, Bucket*> samples_;
+
+    static size_t offsetOf(size_t align)
+    {
+        return (align > PREFIX_SIZE ? align : PREFIX_SIZE);
+    }
+
+    void count(size_t size)
+    {
+        allocs_.fetch_add(1, std::memory_order_relaxed);
+        histogram_[size == 0 ? 0 : 64 - __builtin_clzll(size)].fetch_add(1, std::memory_order_relaxed);
+        size_t live = live_.fetch_add(size, std::memory_order_relaxed) + size;
+        size_t peak = peak_.load(std::memory_order_relaxed);
+        while (live > peak && !peak_.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    // Exponentially distributed with the mean of sample_bytes_.
+    long long nextInterval()
+    {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        return static_cast<long long>(-std::log(1.0 - uniform(gen_)) * sample_bytes_) + 1;
+    }
+
+    void sample(char *data, Prefix *prefix)
+    {
+        void *frames[MAX_DEPTH + 2];
+        int depth = backtrace(frames, MAX_DEPTH + 2);
+        CMemoryManagerSwitcher bypass(nullptr);
+        std::lock_guard<std::mutex> lock(mutex_);
+        until_sample_.store(nextInterval(), std::memory_order_relaxed);
+        // The first two frames are this function and Alloc.
+        std::vector<void*> stack(frames + (depth < 2 ? depth : 2), frames + depth);
+        Bucket &bucket = buckets_.insert(std::make_pair(std::move(stack), Bucket{0, 0, 0, 0})).first->second;
+        ++bucket.live_count;
+        bucket.live_bytes += prefix->size;
+        ++bucket.alloc_count;
+        bucket.alloc_bytes += prefix->size;
+        samples_[data] = &bucket;
+        prefix->sampled = 1;
+    }
+
+    void unsample(char *data, size_t size)
+    {
+        CMemoryManagerSwitcher bypass(nullptr);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = samples_.find(data);
+        if (found == samples_.end())
+            return;
+        --found->second->live_count;
+        found->second->live_bytes -= size;
+        samples_.erase(found);
+    }
+
+    static void writeCounts(std::ostream &out, const Bucket &bucket)
+    {
+        out << bucket.live_count << ": " << bucket.live_bytes << " [" << bucket.alloc_count << ": "
+            << bucket.alloc_bytes << ']';
+    }
+};
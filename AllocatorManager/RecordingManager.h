@@ -0,0 +1,155 @@
+# pragma once
+# include "MemoryManager.h"
+# include <cstddef>
+# include <cstdint>
+# include <cstdio>
+# include <new>
+# include <atomic>
+# include <mutex>
+# include <chrono>
+# include <stdexcept>
+
+// One event of a trace. A trace file is TRACE_MAGIC followed by the records
+// in the order the events happened.
+struct TraceRecord
+{
+    static const uint32_t MAX_SIZE = ~uint32_t(0);
+
+    enum Op : uint8_t
+    {
+        ALLOC = 0,
+        FREE = 1
+    };
+
+    // Nanoseconds since recording started.
+    uint64_t time;
+    // Numbers allocations from 0 on; a free names the allocation it ends.
+    uint64_t id;
+    // Saturates at MAX_SIZE for blocks of 4 GiB and more.
+    uint32_t size;
+    uint16_t thread;
+    uint8_t op;
+    // Of the alignment, for an allocation.
+    uint8_t align_log;
+};
+
+static const char TRACE_MAGIC[8] = {'A', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// Passes every call on to another manager and writes it down to a trace
+// file, to be replayed against other managers later with replay.cpp.
+// Records are buffered and written under a lock, which orders the events of
+// all threads; ids are kept in a prefix of every block.
+// The wrapped manager must not be headerless: operator delete would find it
+// in PageMap and skip the recording.
+class RecordingManager : public IMemoryManager
+{
+public:
+    static const size_t BUFFER_RECORDS = 4096;
+
+    RecordingManager(IMemoryManager *inner, const char *path):
+        inner_(inner), next_id_(0), buffered_(0), start_(std::chrono::steady_clock::now())
+    {
+        if (inner->Headerless())
+            throw std::invalid_argument("RecordingManager can not wrap a headerless manager");
+        file_ = std::fopen(path, "wb");
+        if (file_ == nullptr)
+            throw std::runtime_error("can not open the trace file");
+        std::fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, file_);
+    }
+
+    RecordingManager(const RecordingManager &other) = delete;
+
+    RecordingManager& operator=(const RecordingManager &other) = delete;
+
+    ~RecordingManager()
+    {
+        flush();
+        std::fclose(file_);
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        return Alloc(size, alignof(std::max_align_t));
+    }
+
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        bool aligned = align != alignof(std::max_align_t);
+        size_t offset = (align > PREFIX_SIZE ? align : PREFIX_SIZE);
+        char *raw = static_cast<char*>(aligned ? inner_->Alloc(size + offset, align) : inner_->Alloc(size + offset));
+        if (raw == nullptr)
+            return nullptr;
+        uint64_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+        new(raw + offset - sizeof(Prefix)) Prefix{id, size, static_cast<uint32_t>(offset), aligned};
+        record(TraceRecord::ALLOC, id, size, align);
+        return raw + offset;
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        char *data = static_cast<char*>(ptr);
+        const Prefix *prefix = reinterpret_cast<const Prefix*>(data) - 1;
+        size_t offset = prefix->offset;
+        record(TraceRecord::FREE, prefix->id, prefix->size, 0);
+        if (prefix->aligned == 0)
+            inner_->Free(data - offset, prefix->size + offset);
+        else
+            inner_->Free(data - offset);
+    }
+
+    // Writes out the buffered records.
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write();
+        std::fflush(file_);
+    }
+private:
+    // Right before the memory handed out. Over-aligned blocks are freed
+    // unsized, as the manager may have served them from a larger class.
+    struct Prefix
+    {
+        uint64_t id;
+        size_t size;
+        uint32_t offset;
+        uint32_t aligned;
+    };
+
+    // A multiple of the default alignment that holds the prefix.
+    static const size_t PREFIX_SIZE = 2 * alignof(std::max_align_t);
+
+    IMemoryManager *inner_;
+    std::FILE *file_;
+    std::atomic<uint64_t> next_id_;
+    std::mutex mutex_;
+    TraceRecord buffer_[BUFFER_RECORDS];
+    size_t buffered_;
+    const std::chrono::steady_clock::time_point start_;
+
+    // Threads are numbered in the order they first allocate or free.
+    static uint16_t threadIndex()
+    {
+        static std::atomic<uint16_t> next(0);
+        static thread_local uint16_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    void record(uint8_t op, uint64_t id, size_t size, size_t align)
+    {
+        uint16_t thread = threadIndex();
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        uint32_t clamped = (size < TraceRecord::MAX_SIZE ? static_cast<uint32_t>(size) : TraceRecord::MAX_SIZE);
+        buffer_[buffered_++] = TraceRecord{time, id, clamped, thread, op,
+                                           static_cast<uint8_t>(align == 0 ? 0 : __builtin_ctzll(align))};
+        if (buffered_ == BUFFER_RECORDS)
+            write();
+    }
+
+    void write()
+    {
+        std::fwrite(buffer_, sizeof(TraceRecord), buffered_, file_);
+        buffered_ = 0;
+    }
+};
@@ -0,0 +1,103 @@
+# pragma once
+# include "MemoryManager.h"
+# include <cstddef>
+# include <cstdint>
+# include <algorithm>
+# include <new>
+# include <sys/mman.h>
+
+// Size classes of the slab based managers: GRANULARITY apart up to 256 bytes,
+// then four per power of two, so no slot wastes more than a fifth of itself.
+class SizeClasses
+{
+public:
+    static const size_t GRANULARITY = 16;
+    static const size_t MAX_SIZE = 8192;
+    static const size_t SMALL_NUM = 256 / GRANULARITY;
+    static const size_t NUM = SMALL_NUM + 4 * 5;
+
+    static size_t classOf(size_t size)
+    {
+        if (size <= SMALL_NUM * GRANULARITY)
+            return (size == 0 ? 0 : (size - 1) / GRANULARITY);
+        size_t last = size - 1;
+        size_t power = 63 - __builtin_clzll(last);
+        return SMALL_NUM + (power - 8) * 4 + ((last >> (power - 2)) & 3);
+    }
+
+    // The first slot of a slab is this aligned, so the slots of a class whose
+    // size is a multiple of an alignment up to it all have that alignment.
+    static const size_t MAX_ALIGN = 64;
+
+    // The class for memory aligned to align, NUM if there is none.
+    static size_t classOf(size_t size, size_t align)
+    {
+        size = (std::max(size, align) + align - 1) & ~(align - 1);
+        if (align > MAX_ALIGN || size > MAX_SIZE)
+            return NUM;
+        size_t cls = classOf(size);
+        // Powers of two are classes of their own.
+        if (classSize(cls) % align != 0)
+            cls = classOf(size_t(1) << (64 - __builtin_clzll(size - 1)));
+        return cls;
+    }
+
+    // The size of a slab header, so that the first slot is MAX_ALIGN-aligned.
+    static constexpr size_t headerSize(size_t bytes)
+    {
+        return (bytes + MAX_ALIGN - 1) / MAX_ALIGN * MAX_ALIGN;
+    }
+
+    static size_t classSize(size_t cls)
+    {
+        if (cls < SMALL_NUM)
+            return (cls + 1) * GRANULARITY;
+        size_t power = (cls - SMALL_NUM) / 4 + 8;
+        return (5 + (cls - SMALL_NUM) % 4) << (power - 2);
+    }
+};
+
+// SLAB_SIZE-aligned mappings, so that the header at the start of a slab is
+// found by masking any pointer into it. posix_memalign with such an alignment
+// fragments the heap badly under churn, so the slabs are mapped and trimmed.
+// The slabs of a headerless manager are registered in PageMap as its own.
+class SlabMemory
+{
+public:
+    static const size_t SLAB_SIZE = PageMap::CHUNK_SIZE;
+    static const size_t OS_PAGE_SIZE = 4096;
+
+    static size_t roundSize(size_t bytes)
+    {
+        return (bytes + OS_PAGE_SIZE - 1) / OS_PAGE_SIZE * OS_PAGE_SIZE;
+    }
+
+    // bytes must be rounded with roundSize.
+    static void* map(size_t bytes, IMemoryManager *owner)
+    {
+        void *mem = mmap(nullptr, bytes + SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw std::bad_alloc();
+        char *raw = static_cast<char*>(mem);
+        size_t head = (SLAB_SIZE - reinterpret_cast<uintptr_t>(raw) % SLAB_SIZE) % SLAB_SIZE;
+        if (head != 0)
+            munmap(raw, head);
+        if (head != SLAB_SIZE)
+            munmap(raw + head + bytes, SLAB_SIZE - head);
+        if (owner != nullptr && owner->Headerless())
+            PageMap::set(raw + head, bytes, owner);
+        return raw + head;
+    }
+
+    static void unmap(void *ptr, size_t bytes)
+    {
+        PageMap::set(ptr, bytes, nullptr);
+        munmap(ptr, bytes);
+    }
+
+    template<typename Header>
+    static Header* headerOf(void *ptr)
+    {
+        return reinterpret_cast<Header*>(reinterpret_cast<uintptr_t>(ptr) & ~(SLAB_SIZE - 1));
+    }
+};
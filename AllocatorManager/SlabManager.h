@@ -0,0 +1,286 @@
+# pragma once
+# include "MemoryManager.h"
+# include "SizeClasses.h"
+# include <cstddef>
+# include <new>
+# include <atomic>
+# include <thread>
+# include <cassert>
+
+// Segregated size classes, each taking slots from its own slabs. Requests
+// above SizeClasses::MAX_SIZE get a slab of their own; a few freed ones are
+// kept for reuse. A slab that becomes empty is returned to the system unless
+// it is the last one with room in its class.
+// The manager never calls operator new itself: it runs underneath it.
+// Only the thread that created the manager allocates from it, which is
+// asserted: the slabs are not locked, so a pool thread must install a manager
+// of its own. Memory freed by other threads is pushed onto a lock-free stack
+// and reclaimed by the owner.
+// Headerless by default: operator delete finds the manager of a slot in PageMap.
+class SlabManager : public IMemoryManager
+{
+public:
+    explicit SlabManager(bool headerless = true):
+        IMemoryManager(headerless), owner_(std::this_thread::get_id()), remote_(nullptr),
+        all_(nullptr), large_(nullptr), large_num_(0), slabs_(0)
+    {
+        for (size_t i = 0; i < SizeClasses::NUM; ++i)
+            partial_[i] = nullptr;
+    }
+
+    SlabManager(const SlabManager &other) = delete;
+
+    SlabManager& operator=(const SlabManager &other) = delete;
+
+    ~SlabManager()
+    {
+        while (all_ != nullptr)
+        {
+            Slab *next = all_->all_next;
+            freeSlab(all_);
+            all_ = next;
+        }
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        assert(std::this_thread::get_id() == owner_);
+        if (remote_.load(std::memory_order_relaxed) != nullptr)
+            collect();
+        if (size > SizeClasses::MAX_SIZE)
+            return allocLarge(size, SizeClasses::GRANULARITY);
+        return allocSlot(SizeClasses::classOf(size));
+    }
+
+    // Alignments up to half a slab.
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        assert(std::this_thread::get_id() == owner_);
+        if (align <= SizeClasses::GRANULARITY)
+            return Alloc(size);
+        if (align >= SlabMemory::SLAB_SIZE)
+            throw std::bad_alloc();
+        if (remote_.load(std::memory_order_relaxed) != nullptr)
+            collect();
+        size_t cls = SizeClasses::classOf(size, align);
+        if (cls == SizeClasses::NUM)
+            return allocLarge(size, align);
+        return allocSlot(cls);
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        if (std::this_thread::get_id() != owner_)
+        {
+            FreeSlot *slot = new(ptr) FreeSlot{remote_.load(std::memory_order_relaxed)};
+            while (!remote_.compare_exchange_weak(slot->next, slot, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {}
+            return;
+        }
+        freeLocal(ptr);
+    }
+
+    // Takes back the memory other threads have freed. The owner does it by
+    // itself on its next allocation.
+    void collect()
+    {
+        FreeSlot *slot = remote_.exchange(nullptr, std::memory_order_acquire);
+        while (slot != nullptr)
+        {
+            FreeSlot *next = slot->next;
+            freeLocal(slot);
+            slot = next;
+        }
+    }
+
+    size_t slabsNum() const
+    {
+        return slabs_;
+    }
+private:
+    static const size_t LARGE = SizeClasses::NUM;
+    static const size_t LARGE_CACHE_NUM = 16;
+
+    struct FreeSlot
+    {
+        FreeSlot *next;
+    };
+
+    struct Slab
+    {
+        size_t cls;
+        size_t size;
+        size_t used;
+        FreeSlot *free;
+        char *bump, *end;
+        Slab *prev, *next;
+        Slab *all_prev, *all_next;
+    };
+
+    static const size_t HEADER_SIZE = SizeClasses::headerSize(sizeof(Slab));
+
+    const std::thread::id owner_;
+    std::atomic<FreeSlot*> remote_;
+    Slab *partial_[SizeClasses::NUM];
+    Slab *all_;
+    Slab *large_;
+    size_t large_num_;
+    size_t slabs_;
+
+    void* allocSlot(size_t cls)
+    {
+        Slab *slab = partial_[cls];
+        if (slab == nullptr)
+            slab = addSlab(cls);
+        void *result;
+        if (slab->free != nullptr)
+        {
+            result = slab->free;
+            slab->free = slab->free->next;
+        }
+        else
+        {
+            result = slab->bump;
+            slab->bump += slab->size;
+        }
+        ++slab->used;
+        if (isFull(slab))
+            unlinkPartial(slab);
+        return result;
+    }
+
+    void freeLocal(void *ptr)
+    {
+        Slab *slab = SlabMemory::headerOf<Slab>(ptr);
+        if (slab->cls == LARGE)
+        {
+            cacheLarge(slab);
+            return;
+        }
+        if (isFull(slab))
+            linkPartial(slab);
+        slab->free = new(ptr) FreeSlot{slab->free};
+        --slab->used;
+        if (slab->used == 0 && (partial_[slab->cls] != slab || slab->next != nullptr))
+        {
+            unlinkPartial(slab);
+            releaseSlab(slab);
+        }
+    }
+
+    static bool isFull(const Slab *slab)
+    {
+        return slab->free == nullptr && slab->bump + slab->size > slab->end;
+    }
+
+    static void freeSlab(Slab *slab)
+    {
+        SlabMemory::unmap(slab, slab->end - reinterpret_cast<char*>(slab));
+    }
+
+    Slab* newSlab(size_t cls, size_t size, size_t bytes)
+    {
+        bytes = SlabMemory::roundSize(bytes);
+        void *mem = SlabMemory::map(bytes, this);
+        char *begin = static_cast<char*>(mem);
+        Slab *slab = new(mem) Slab{cls, size, 0, nullptr, begin + HEADER_SIZE, begin + bytes,
+                                   nullptr, nullptr, nullptr, all_};
+        if (all_ != nullptr)
+            all_->all_prev = slab;
+        all_ = slab;
+        ++slabs_;
+        return slab;
+    }
+
+    Slab* addSlab(size_t cls)
+    {
+        Slab *slab = newSlab(cls, SizeClasses::classSize(cls), SlabMemory::SLAB_SIZE);
+        linkPartial(slab);
+        return slab;
+    }
+
+    // A cached slab is reused if it wastes at most half of itself.
+    void* allocLarge(size_t size, size_t align)
+    {
+        size_t offset = (align > HEADER_SIZE ? align : HEADER_SIZE);
+        Slab *slab = large_;
+        while (slab != nullptr)
+        {
+            size_t bytes = slab->end - reinterpret_cast<char*>(slab);
+            if (offset + size <= bytes && bytes - offset <= 2 * size)
+                break;
+            slab = slab->next;
+        }
+        if (slab != nullptr)
+        {
+            unlinkLarge(slab);
+            slab->size = size;
+        }
+        else
+        {
+            slab = newSlab(LARGE, size, offset + size);
+        }
+        slab->bump = reinterpret_cast<char*>(slab) + offset;
+        ++slab->used;
+        return slab->bump;
+    }
+
+    void cacheLarge(Slab *slab)
+    {
+        if (large_num_ == LARGE_CACHE_NUM)
+        {
+            releaseSlab(slab);
+            return;
+        }
+        --slab->used;
+        slab->prev = nullptr;
+        slab->next = large_;
+        if (large_ != nullptr)
+            large_->prev = slab;
+        large_ = slab;
+        ++large_num_;
+    }
+
+    void unlinkLarge(Slab *slab)
+    {
+        if (slab->prev != nullptr)
+            slab->prev->next = slab->next;
+        else
+            large_ = slab->next;
+        if (slab->next != nullptr)
+            slab->next->prev = slab->prev;
+        --large_num_;
+    }
+
+    void releaseSlab(Slab *slab)
+    {
+        if (slab->all_prev != nullptr)
+            slab->all_prev->all_next = slab->all_next;
+        else
+            all_ = slab->all_next;
+        if (slab->all_next != nullptr)
+            slab->all_next->all_prev = slab->all_prev;
+        --slabs_;
+        freeSlab(slab);
+    }
+
+    void linkPartial(Slab *slab)
+    {
+        slab->prev = nullptr;
+        slab->next = partial_[slab->cls];
+        if (slab->next != nullptr)
+            slab->next->prev = slab;
+        partial_[slab->cls] = slab;
+    }
+
+    void unlinkPartial(Slab *slab)
+    {
+        if (slab->prev != nullptr)
+            slab->prev->next = slab->next;
+        else
+            partial_[slab->cls] = slab->next;
+        if (slab->next != nullptr)
+            slab->next->prev = slab->prev;
+        slab->prev = slab->next = nullptr;
+    }
+};
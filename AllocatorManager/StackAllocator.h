@@ -1,6 +1,10 @@
 # pragma once
 # include <cstddef>
 # include <memory>
+# include <algorithm>
+# include <new>
+# include <sys/mman.h>
+# include <unistd.h>
 
 // class RuntimeHeap
 // {
@@ -171,18 +175,94 @@
 //     alloc->Free(mem);
 // }
 
+// The arena is in a namespace of its own: XORList/StackAllocator.h defines
+// classes of the same names, and both are built into test_matrix.cpp.
+namespace manager
+{
+
+// Byte counters of an arena. Tail waste is the free space left in blocks that
+// were abandoned for a new one, alignment waste is the padding std::align added.
+struct ArenaStats
+{
+    size_t requested;
+    size_t reserved;
+    size_t blocks;
+    size_t tail_waste;
+    size_t alignment_waste;
+};
+
+enum class BlockSource
+{
+    Heap,
+    Mmap,
+    HugePages
+};
+
+// Memory for arena blocks. Mapped blocks are returned to the system as soon as
+// the arena dies; huge page blocks are additionally 2 MiB aligned and marked
+// with MADV_HUGEPAGE. Neither goes through operator new.
+class BlockMemory
+{
+public:
+    static size_t roundSize(size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            return size;
+        size_t granularity = HUGE_PAGE_SIZE;
+        if (source == BlockSource::Mmap)
+            granularity = sysconf(_SC_PAGESIZE);
+        return (size + granularity - 1) / granularity * granularity;
+    }
+
+    static char* allocate(size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            return new(std::malloc(size * sizeof(char))) char[size];
+        size = roundSize(size, source);
+        size_t slack = (source == BlockSource::HugePages ? HUGE_PAGE_SIZE : 0);
+        void *mem = mmap(nullptr, size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw std::bad_alloc();
+        char *begin = static_cast<char*>(mem);
+        if (slack != 0)
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(mem);
+            size_t head = (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+            if (head != 0)
+                munmap(begin, head);
+            if (slack != head)
+                munmap(begin + head + size, slack - head);
+            begin += head;
+# ifdef MADV_HUGEPAGE
+            madvise(begin, size, MADV_HUGEPAGE);
+# endif
+        }
+        return begin;
+    }
+
+    static void free(char *ptr, size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            std::free(ptr);
+        else
+            munmap(ptr, roundSize(size, source));
+    }
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+};
+
 class Block
 {
 public:
 
-    explicit Block(Block *previous = nullptr, size_t size = SIZE):
-        begin_(new(std::malloc(size * sizeof(char))) char[size]), end_(begin_ + size), 
+    explicit Block(Block *previous = nullptr, size_t size = SIZE, BlockSource source = BlockSource::Heap):
+        begin_(BlockMemory::allocate(size, source)), end_(begin_ + size), 
         curr_(reinterpret_cast<void*>(begin_)),
-        space_(size), prev_(previous) {}
+        space_(size), prev_(previous), source_(source) {}
 
     ~Block()
     {
-        std::free(begin_);
+        BlockMemory::free(begin_, end_ - begin_, source_);
         if (prev_ != nullptr)
         {
             prev_->~Block();
@@ -190,9 +270,9 @@ public:
         }
     }
 
-    void* allocAligned(size_t size)
+    void* allocAligned(size_t size, size_t align = alignof(std::max_align_t))
     {
-        if (std::align(alignof(std::max_align_t), size, curr_, space_))
+        if (std::align(align, size, curr_, space_))
         {
             void *result = curr_;
             curr_ = reinterpret_cast<char*>(curr_) + size;
@@ -201,19 +281,52 @@ public:
         }
         return nullptr;
     }
+
+    void* position() const
+    {
+        return curr_;
+    }
+
+    size_t space() const
+    {
+        return space_;
+    }
+
+    void rewind(void *position)
+    {
+        space_ += reinterpret_cast<char*>(curr_) - reinterpret_cast<char*>(position);
+        curr_ = position;
+    }
+
+    Block* detachPrevious()
+    {
+        Block *previous = prev_;
+        prev_ = nullptr;
+        return previous;
+    }
+
+    static const size_t SIZE;
 private:
     char *begin_, *end_;
     void *curr_;
     size_t space_;
     Block *prev_;
-    static const size_t SIZE;
+    BlockSource source_;
 };
 const size_t Block::SIZE = 100000;
 
 class MemoryBlocks
 {
 public:
-    MemoryBlocks() : cnt_(0), curr_(nullptr) {}
+    struct Marker
+    {
+        Block *block;
+        void *position;
+        ArenaStats stats;
+    };
+
+    explicit MemoryBlocks(BlockSource source = BlockSource::Heap):
+        cnt_(0), curr_(nullptr), source_(source), stats_() {}
 
     ~MemoryBlocks()
     {
@@ -244,36 +357,89 @@ public:
         return cnt_ == 0;
     }
 
-    void* allocMemory(size_t size)
+    void* allocMemory(size_t size, size_t align = alignof(std::max_align_t))
     {
-        if (curr_ == nullptr)
-            addBlock();
-        void *result = curr_->allocAligned(size);
-        if (result != nullptr)
-            return result;
-        addBlock();
-        return curr_->allocAligned(size);
+        if (curr_ != nullptr)
+        {
+            void *result = allocFromCurrent(size, align);
+            if (result != nullptr)
+                return result;
+            stats_.tail_waste += curr_->space();
+        }
+        addBlock(std::max(Block::SIZE, size + align));
+        return allocFromCurrent(size, align);
+    }
+
+    const ArenaStats& stats() const
+    {
+        return stats_;
+    }
+
+    Marker mark() const
+    {
+        return Marker{curr_, curr_ == nullptr ? nullptr : curr_->position(), stats_};
+    }
+
+    // Frees every block added after the marker was taken and moves the bump
+    // pointer back. Markers must be rewound in LIFO order.
+    void rewind(const Marker &marker)
+    {
+        while (curr_ != marker.block)
+        {
+            Block *previous = curr_->detachPrevious();
+            curr_->~Block();
+            std::free(curr_);
+            curr_ = previous;
+        }
+        if (curr_ != nullptr)
+            curr_->rewind(marker.position);
+        stats_ = marker.stats;
     }
 private:
     size_t cnt_;
     Block *curr_;
+    BlockSource source_;
+    ArenaStats stats_;
 
-    void addBlock()
+    void* allocFromCurrent(size_t size, size_t align)
     {
+        size_t space = curr_->space();
+        void *result = curr_->allocAligned(size, align);
+        if (result != nullptr)
+        {
+            stats_.requested += size;
+            stats_.alignment_waste += space - curr_->space() - size;
+        }
+        return result;
+    }
 
-        curr_ = new(std::malloc(sizeof(Block))) Block(curr_);
+    void addBlock(size_t size)
+    {
+        size = BlockMemory::roundSize(size, source_);
+        curr_ = new(std::malloc(sizeof(Block))) Block(curr_, size, source_);
+        stats_.reserved += size;
+        ++stats_.blocks;
     }
 };
 
 class StackAllocator : public IMemoryManager
 {
 public:
+    friend class ArenaScope;
+    using Marker = MemoryBlocks::Marker;
+
     StackAllocator()
     {
         mb_ = new(std::malloc(sizeof(MemoryBlocks))) MemoryBlocks();
         mb_->addReference();
     }
 
+    explicit StackAllocator(BlockSource source)
+    {
+        mb_ = new(std::malloc(sizeof(MemoryBlocks))) MemoryBlocks(source);
+        mb_->addReference();
+    }
+
     ~StackAllocator()
     {
         mb_->eraseReference();
@@ -289,11 +455,63 @@ public:
         return mb_->allocMemory(size);
     }
 
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        return mb_->allocMemory(size, align);
+    }
+
     virtual void Free(void *ptr) override {}
+
+    const ArenaStats& stats() const
+    {
+        return mb_->stats();
+    }
+
+    Marker mark() const
+    {
+        return mb_->mark();
+    }
+
+    void rewind(const Marker &marker)
+    {
+        mb_->rewind(marker);
+    }
 private:
     MemoryBlocks *mb_;
 };
 
+// Everything allocated from the arena during the lifetime of the scope is
+// released at once when it ends, including memory handed out by operator new
+// while the allocator was installed with CMemoryManagerSwitcher.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(StackAllocator &alloc) : mb_(alloc.mb_), marker_(mb_->mark())
+    {
+        mb_->addReference();
+    }
+
+    ArenaScope(const ArenaScope &other) = delete;
+
+    ArenaScope& operator=(const ArenaScope &other) = delete;
+
+    ~ArenaScope()
+    {
+        mb_->rewind(marker_);
+        mb_->eraseReference();
+        if (mb_->needDestruct())
+        {
+            mb_->~MemoryBlocks();
+            std::free(mb_);
+        }
+    }
+private:
+    MemoryBlocks *mb_;
+    MemoryBlocks::Marker marker_;
+};
+
+}
+
 // template<typename AllocStrategy>
 // class CAllocatedOn
 // {
@@ -0,0 +1,255 @@
+# pragma once
+# include "MemoryManager.h"
+# include "SizeClasses.h"
+# include <cstddef>
+# include <cstdint>
+# include <new>
+# include <mutex>
+
+// Two-Level Segregated Fit over one region reserved and touched up front, so
+// that no call ever takes a page fault or a system call. Free blocks are kept
+// in lists by a power of two (first level) and one of SL_COUNT slices of it
+// (second level); two bitmaps find a non-empty list of large enough blocks
+// with two bit scans. A freed block merges with its free physical neighbours
+// at once. Every operation is a bounded number of steps whatever the heap
+// holds; what is lost in exchange is up to a 1/SL_COUNT of each request.
+class TlsfManager : public IMemoryManager
+{
+public:
+    explicit TlsfManager(size_t capacity = size_t(64) << 20, bool headerless = true):
+        IMemoryManager(headerless), fl_bitmap_(0)
+    {
+        bytes_ = SlabMemory::roundSize(capacity);
+        base_ = static_cast<char*>(SlabMemory::map(bytes_, this));
+        for (size_t offset = 0; offset < bytes_; offset += SlabMemory::OS_PAGE_SIZE)
+            base_[offset] = 0;
+        for (size_t fl = 0; fl < FL_COUNT; ++fl)
+        {
+            sl_bitmaps_[fl] = 0;
+            for (size_t sl = 0; sl < SL_COUNT; ++sl)
+                heads_[fl][sl] = nullptr;
+        }
+        // One free block spanning the region, then a used empty block that
+        // stops merging at the end.
+        Block *block = reinterpret_cast<Block*>(base_);
+        block->prev_phys = nullptr;
+        block->size = bytes_ - 2 * HEADER_SIZE;
+        Block *sentinel = next(block);
+        sentinel->prev_phys = block;
+        sentinel->size = 0;
+        insert(block);
+    }
+
+    TlsfManager(const TlsfManager &other) = delete;
+
+    TlsfManager& operator=(const TlsfManager &other) = delete;
+
+    ~TlsfManager()
+    {
+        SlabMemory::unmap(base_, bytes_);
+    }
+
+    virtual void* Alloc(size_t size) override
+    {
+        if (size > bytes_)
+            return nullptr;
+        size = adjust(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Block *block = take(size);
+        if (block == nullptr)
+            return nullptr;
+        trim(block, size);
+        return data(block);
+    }
+
+    // Any alignment: the block found has room to cut a free block off its
+    // front that brings the data to the alignment.
+    virtual void* Alloc(size_t size, size_t align) override
+    {
+        if (align <= ALIGN)
+            return Alloc(size);
+        if (size > bytes_ || align > bytes_)
+            return nullptr;
+        size = adjust(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Block *block = take(size + align + MIN_BLOCK);
+        if (block == nullptr)
+            return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(data(block));
+        uintptr_t aligned = (start + align - 1) & ~uintptr_t(align - 1);
+        if (aligned != start && aligned - start < MIN_BLOCK)
+            aligned = (start + MIN_BLOCK + align - 1) & ~uintptr_t(align - 1);
+        if (aligned != start)
+        {
+            Block *front = block;
+            block = reinterpret_cast<Block*>(aligned - HEADER_SIZE);
+            block->prev_phys = front;
+            block->size = front->size - (aligned - start);
+            next(block)->prev_phys = block;
+            front->size = aligned - start - HEADER_SIZE;
+            insert(front);
+        }
+        trim(block, size);
+        return data(block);
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        Block *block = reinterpret_cast<Block*>(static_cast<char*>(ptr) - HEADER_SIZE);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Block *prev = block->prev_phys;
+        if (prev != nullptr && isFree(prev))
+        {
+            remove(prev);
+            prev->size += HEADER_SIZE + block->size;
+            next(prev)->prev_phys = prev;
+            block = prev;
+        }
+        Block *following = next(block);
+        if (isFree(following))
+        {
+            remove(following);
+            block->size += HEADER_SIZE + following->size;
+            next(block)->prev_phys = block;
+        }
+        insert(block);
+    }
+private:
+    static const size_t ALIGN = 16;
+    static const size_t SL_LOG = 5;
+    static const size_t SL_COUNT = size_t(1) << SL_LOG;
+    // Blocks below SMALL_SIZE are all in the first level, ALIGN apart.
+    static const size_t FL_SHIFT = SL_LOG + 4;
+    static const size_t SMALL_SIZE = size_t(1) << FL_SHIFT;
+    static const size_t FL_COUNT = 64 - FL_SHIFT + 1;
+
+    struct Block
+    {
+        Block *prev_phys;
+        // Of the data, the lowest bit is set while the block is free.
+        size_t size;
+        // Only valid while the block is free, they are its first data bytes.
+        Block *next_free, *prev_free;
+    };
+
+    static const size_t FREE = 1;
+    static const size_t HEADER_SIZE = 2 * sizeof(void*);
+    // A free block must hold its links.
+    static const size_t MIN_BLOCK = sizeof(Block);
+
+    char *base_;
+    size_t bytes_;
+    std::mutex mutex_;
+    uint64_t fl_bitmap_;
+    uint64_t sl_bitmaps_[FL_COUNT];
+    Block *heads_[FL_COUNT][SL_COUNT];
+
+    static size_t adjust(size_t size)
+    {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+        return (size < MIN_BLOCK - HEADER_SIZE ? MIN_BLOCK - HEADER_SIZE : size);
+    }
+
+    static char* data(Block *block)
+    {
+        return reinterpret_cast<char*>(block) + HEADER_SIZE;
+    }
+
+    static Block* next(Block *block)
+    {
+        return reinterpret_cast<Block*>(data(block) + (block->size & ~FREE));
+    }
+
+    static bool isFree(const Block *block)
+    {
+        return (block->size & FREE) != 0;
+    }
+
+    // The lists a block of size belongs to.
+    static void mapping(size_t size, size_t &fl, size_t &sl)
+    {
+        if (size < SMALL_SIZE)
+        {
+            fl = 0;
+            sl = size / (SMALL_SIZE / SL_COUNT);
+            return;
+        }
+        size_t power = 63 - __builtin_clzll(size);
+        sl = (size >> (power - SL_LOG)) ^ SL_COUNT;
+        fl = power - FL_SHIFT + 1;
+    }
+
+    // Takes a free block of at least size out of its list, or nullptr. The
+    // size is rounded up to the next list first, so that any block of the
+    // list found is large enough.
+    Block* take(size_t size)
+    {
+        if (size >= SMALL_SIZE)
+            size += (size_t(1) << (63 - __builtin_clzll(size) - SL_LOG)) - 1;
+        size_t fl, sl;
+        mapping(size, fl, sl);
+        if (fl >= FL_COUNT)
+            return nullptr;
+        uint64_t sl_map = sl_bitmaps_[fl] & (~uint64_t(0) << sl);
+        if (sl_map == 0)
+        {
+            uint64_t fl_map = fl_bitmap_ & (~uint64_t(0) << (fl + 1));
+            if (fl_map == 0)
+                return nullptr;
+            fl = __builtin_ctzll(fl_map);
+            sl_map = sl_bitmaps_[fl];
+        }
+        sl = __builtin_ctzll(sl_map);
+        Block *block = heads_[fl][sl];
+        remove(block);
+        return block;
+    }
+
+    // Gives the end of a taken block beyond size back as a free block.
+    void trim(Block *block, size_t size)
+    {
+        block->size &= ~FREE;
+        if (block->size < size + MIN_BLOCK)
+            return;
+        Block *rest = reinterpret_cast<Block*>(data(block) + size);
+        rest->prev_phys = block;
+        rest->size = block->size - size - HEADER_SIZE;
+        next(rest)->prev_phys = rest;
+        block->size = size;
+        insert(rest);
+    }
+
+    void insert(Block *block)
+    {
+        size_t fl, sl;
+        block->size &= ~FREE;
+        mapping(block->size, fl, sl);
+        block->size |= FREE;
+        block->prev_free = nullptr;
+        block->next_free = heads_[fl][sl];
+        if (block->next_free != nullptr)
+            block->next_free->prev_free = block;
+        heads_[fl][sl] = block;
+        fl_bitmap_ |= uint64_t(1) << fl;
+        sl_bitmaps_[fl] |= uint64_t(1) << sl;
+    }
+
+    void remove(Block *block)
+    {
+        size_t fl, sl;
+        block->size &= ~FREE;
+        mapping(block->size, fl, sl);
+        if (block->prev_free != nullptr)
+            block->prev_free->next_free = block->next_free;
+        else
+            heads_[fl][sl] = block->next_free;
+        if (block->next_free != nullptr)
+            block->next_free->prev_free = block->prev_free;
+        if (heads_[fl][sl] == nullptr)
+        {
+            sl_bitmaps_[fl] &= ~(uint64_t(1) << sl);
+            if (sl_bitmaps_[fl] == 0)
+                fl_bitmap_ &= ~(uint64_t(1) << fl);
+        }
+    }
+};
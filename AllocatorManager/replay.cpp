@@ -0,0 +1,170 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "RecordingManager.h"
+# include "SlabManager.h"
+# include "CachingManager.h"
+# include "TlsfManager.h"
+# include "BuddyManager.h"
+# include <vector>
+# include <string>
+# include <chrono>
+# include <cstdio>
+# include <cstring>
+# include <sys/wait.h>
+# include <unistd.h>
+
+
+// Replays a trace written by RecordingManager against every manager, on one
+// thread, in the order the events were recorded, and reports the throughput,
+// the peak resident memory the manager needed and the share of it the peak
+// of live bytes does not account for.
+// Reads the path of the trace from stdin.
+
+size_t residentKib()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm != nullptr)
+    {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+bool load(const std::string &path, std::vector<TraceRecord> &records)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    char magic[sizeof(TRACE_MAGIC)];
+    bool valid = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+                 std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    TraceRecord record;
+    while (valid && std::fread(&record, sizeof(record), 1, file) == 1)
+        records.push_back(record);
+    std::fclose(file);
+    return valid;
+}
+
+// Every page of a block is touched, so that the resident size is what the
+// manager really holds, counted from start_rss, taken before the manager was
+// made. blocks has a null for every id, made beforehand not to be counted.
+// Resident memory is sampled every SAMPLE_EVERY events.
+void replay(IMemoryManager *manager, const std::vector<TraceRecord> &records, std::vector<char*> &blocks,
+            size_t start_rss)
+{
+    const size_t SAMPLE_EVERY = 1024;
+    size_t peak_rss = 0;
+    size_t live = 0, peak_live = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const TraceRecord &record = records[i];
+        if (record.op == TraceRecord::ALLOC)
+        {
+            size_t align = size_t(1) << record.align_log;
+            char *block = static_cast<char*>(align <= alignof(std::max_align_t) ? manager->Alloc(record.size) :
+                                             manager->Alloc(record.size, align));
+            if (block == nullptr)
+            {
+                std::printf("  out of memory at event %zu\n", i);
+                return;
+            }
+            for (size_t offset = 0; offset < record.size; offset += 4096)
+                block[offset] = 1;
+            blocks[record.id] = block;
+            live += record.size;
+            if (live > peak_live)
+                peak_live = live;
+        }
+        else if (blocks[record.id] != nullptr)
+        {
+            manager->Free(blocks[record.id]);
+            blocks[record.id] = nullptr;
+            live -= record.size;
+        }
+        if (i % SAMPLE_EVERY == 0)
+        {
+            size_t rss = (residentKib() - start_rss) * 1024;
+            if (rss > peak_rss)
+                peak_rss = rss;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (char *block : blocks)
+        if (block != nullptr)
+            manager->Free(block);
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::printf("  %8.2f M events/s, peak %8.1f MiB resident for %8.1f MiB live, %5.1f%% overhead\n",
+                records.size() / seconds / 1e6, peak_rss / 1048576.0, peak_live / 1048576.0,
+                (peak_rss <= peak_live ? 0.0 : 100.0 * (peak_rss - peak_live) / peak_rss));
+}
+
+// Each manager runs in a process of its own, so that none inherits the heap
+// another left.
+template<typename Body>
+void isolated(const std::string &name, Body body)
+{
+    std::cout << name << ":\n";
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    body(residentKib());
+    std::fflush(stdout);
+    _exit(0);
+}
+
+
+int main()
+{
+    std::string path;
+    std::cin >> path;
+    std::vector<TraceRecord> records;
+    if (!load(path, records))
+    {
+        std::cout << "Not a trace: " << path << "\n";
+        return 1;
+    }
+    size_t ids = 0, live = 0, peak_live = 0;
+    for (const TraceRecord &record : records)
+    {
+        if (record.id + 1 > ids)
+            ids = record.id + 1;
+        live = (record.op == TraceRecord::ALLOC ? live + record.size : live - record.size);
+        if (live > peak_live)
+            peak_live = live;
+    }
+    std::cout << records.size() << " events, " << ids << " allocations\n";
+    // TlsfManager touches all its region up front, so it gets what the trace
+    // needs with room to spare, not a gigabyte.
+    size_t tlsf_capacity = 2 * peak_live + (size_t(16) << 20);
+    std::vector<char*> blocks(ids, nullptr);
+    isolated("DefaultManager", [&records, &blocks](size_t start_rss) {
+        DefaultManager manager;
+        replay(&manager, records, blocks, start_rss);
+    });
+    isolated("SlabManager", [&records, &blocks](size_t start_rss) {
+        SlabManager manager;
+        replay(&manager, records, blocks, start_rss);
+    });
+    isolated("CachingManager", [&records, &blocks](size_t start_rss) {
+        CachingManager manager;
+        replay(&manager, records, blocks, start_rss);
+    });
+    isolated("TlsfManager", [&records, &blocks, tlsf_capacity](size_t start_rss) {
+        TlsfManager manager(tlsf_capacity);
+        replay(&manager, records, blocks, start_rss);
+    });
+    isolated("BuddyManager", [&records, &blocks](size_t start_rss) {
+        BuddyManager manager(size_t(1) << 32);
+        replay(&manager, records, blocks, start_rss);
+    });
+    return 0;
+}
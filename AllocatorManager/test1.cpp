@@ -51,8 +51,14 @@ void executeTest()
 int main()
 {
     executeTest<10000>();
-    StackAllocator sa;
-    CMemoryManagerSwitcher own(&sa);
-    executeTest<10000>();
+    manager::StackAllocator sa;
+    {
+        CMemoryManagerSwitcher own(&sa);
+        executeTest<10000>();
+    }
+    const manager::ArenaStats &stats = sa.stats();
+    std::cout << "requested " << stats.requested << " B, reserved " << stats.reserved
+              << " B in " << stats.blocks << " blocks, tail waste " << stats.tail_waste
+              << " B, alignment waste " << stats.alignment_waste << " B\n";
     return 0;
 }
\ No newline at end of file
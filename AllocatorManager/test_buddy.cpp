@@ -0,0 +1,105 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "BuddyManager.h"
+# include <random>
+# include <vector>
+# include <chrono>
+# include <cstdio>
+# include <cmath>
+# include <string>
+# include <cassert>
+# include <sys/wait.h>
+# include <unistd.h>
+
+
+size_t residentKib()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm != nullptr)
+    {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Buffers of log-uniform sizes replace each other at random, the largest size
+// changing every tenth of the run, as the load of a long running service
+// does. Every page of a buffer is touched, so that the resident size is what
+// the allocator really holds.
+void uptime(IMemoryManager *manager, BuddyManager *buddy, size_t slots, size_t steps)
+{
+    const size_t max_sizes[] = {4 << 10, 256 << 10, 16 << 10, 64 << 10, 1 << 10};
+    std::mt19937 gen(42);
+    std::vector<char*> buffers(slots, nullptr);
+    std::vector<size_t> sizes(slots, 0);
+    size_t live = 0;
+    size_t start_rss = residentKib();
+    CMemoryManagerSwitcher switcher(manager);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t max_size = max_sizes[i * 10 / steps % 5];
+        std::uniform_real_distribution<double> exponent(std::log(64.0), std::log(static_cast<double>(max_size)));
+        size_t pos = gen() % slots;
+        live -= sizes[pos];
+        delete[] buffers[pos];
+        sizes[pos] = static_cast<size_t>(std::exp(exponent(gen)));
+        buffers[pos] = new char[sizes[pos]];
+        for (size_t offset = 0; offset < sizes[pos]; offset += 4096)
+            buffers[pos][offset] = 1;
+        live += sizes[pos];
+        if ((i + 1) % (steps / 10) == 0)
+        {
+            std::printf("  step %9zu: %8.1f MiB live, %8.1f MiB resident", i + 1, live / 1048576.0,
+                        (residentKib() - start_rss) / 1024.0);
+            if (buddy != nullptr)
+                std::printf(", %8.1f MiB in blocks, %.1f%% of free memory unusable for 256 KiB",
+                            buddy->allocated() / 1048576.0, 100 * buddy->fragmentation(256 << 10));
+            std::printf("\n");
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (char *buffer : buffers)
+        delete[] buffer;
+    // Everything freed must have merged back into the whole region.
+    assert(buddy == nullptr || buddy->largestFree() == buddy->capacity());
+    std::printf("  %.1f ns per replacement\n", std::chrono::duration<double, std::nano>(end - begin).count() / steps);
+}
+
+// Each manager runs in a process of its own, so neither inherits the heap
+// the other left.
+template<typename Body>
+void isolated(const std::string &name, Body body)
+{
+    std::cout << name << ":\n";
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    body();
+    std::fflush(stdout);
+    _exit(0);
+}
+
+
+int main()
+{
+    size_t slots, steps;
+    std::cin >> slots >> steps;
+    isolated("DefaultManager", [slots, steps]() {
+        DefaultManager heap;
+        uptime(&heap, nullptr, slots, steps);
+    });
+    isolated("BuddyManager", [slots, steps]() {
+        BuddyManager buddy(size_t(1) << 32);
+        uptime(&buddy, &buddy, slots, steps);
+    });
+    return 0;
+}
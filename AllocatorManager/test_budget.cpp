@@ -0,0 +1,102 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include "BudgetManager.h"
+# include <random>
+# include <vector>
+# include <chrono>
+# include <cassert>
+
+
+// Deleted sized, unlike the char buffers.
+struct Record
+{
+    long key;
+    char payload[40];
+};
+
+// Keeps `live` objects, records and buffers of up to 4 KiB in turn, and
+// replaces a random one on every step. Nanoseconds per replacement.
+double churn(IMemoryManager *manager, size_t live, size_t steps)
+{
+    std::mt19937 gen(42);
+    std::vector<void*> objects(live, nullptr);
+    CMemoryManagerSwitcher switcher(manager);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t pos = gen() % live;
+        if (pos % 2 == 0)
+        {
+            delete static_cast<Record*>(objects[pos]);
+            objects[pos] = new Record();
+        }
+        else
+        {
+            delete[] static_cast<char*>(objects[pos]);
+            objects[pos] = new char[16 + gen() % 4096];
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < live; ++pos)
+        if (pos % 2 == 0)
+            delete static_cast<Record*>(objects[pos]);
+        else
+            delete[] static_cast<char*>(objects[pos]);
+    return std::chrono::duration<double, std::nano>(end - begin).count() / steps;
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    SlabManager slab(false);
+    DefaultManager heap;
+    std::cout << "SlabManager:\t\t\t\t" << churn(&slab, live, steps) << " ns per replacement\n";
+    {
+        BudgetManager budget(&slab, size_t(1) << 40);
+        std::cout << "BudgetManager, never full:\t\t" << churn(&budget, live, steps) << " ns per replacement\n";
+        // Every block was given back and accounted, sized or not.
+        assert(budget.used() == 0);
+    }
+    {
+        BudgetManager budget(&slab, live * 1024, &heap);
+        double time = churn(&budget, live, steps);
+        std::cout << "BudgetManager, falling back to malloc:\t" << time << " ns per replacement, peak "
+                  << budget.peak() << " of " << budget.limit() << " bytes\n";
+        assert(budget.used() == 0 && budget.fallbackUsed() == 0);
+        assert(budget.peak() <= budget.limit());
+    }
+    {
+        // A cache that gives its buffers back when the budget runs short. It
+        // starts at twice what the churn leaves room for.
+        BudgetManager budget(&slab, live * 2048);
+        // Reserved beforehand, so that the budget only holds the buffers.
+        std::vector<char*> cache;
+        cache.reserve(live / 2);
+        size_t flushed = 0;
+        budget.onPressure([&cache, &flushed](size_t missing) {
+            for (size_t freed = 0; freed < missing && !cache.empty(); freed += 4096)
+            {
+                delete[] cache.back();
+                cache.pop_back();
+                ++flushed;
+            }
+        });
+        {
+            CMemoryManagerSwitcher switcher(&budget);
+            for (size_t i = 0; i < live / 2; ++i)
+                cache.push_back(new char[4096]);
+        }
+        double time = churn(&budget, live, steps);
+        std::cout << "BudgetManager, flushing a cache:\t" << time << " ns per replacement, " << flushed
+                  << " cached buffers flushed\n";
+        for (char *buffer : cache)
+            delete[] buffer;
+        cache.clear();
+        assert(budget.used() == 0);
+    }
+    return 0;
+}
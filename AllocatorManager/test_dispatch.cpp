@@ -0,0 +1,58 @@
+# include <iostream>
+# ifndef MEMORY_MANAGER_STATIC
+# define MEMORY_MANAGER_STATIC SlabManager
+# define MEMORY_MANAGER_STATIC_HEADER "SlabManager.h"
+# endif
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include <vector>
+# include <chrono>
+# include <cassert>
+
+
+// Only its type differs from SlabManager, so the operators reach it through
+// the vtable while SlabManager itself is called directly.
+class DynamicSlabManager : public SlabManager
+{
+public:
+    explicit DynamicSlabManager(bool headerless) : SlabManager(headerless) {}
+};
+
+// Average cost of one operator new and delete pair, the sizes cycling through
+// a few classes so that the branches in the manager do not all predict.
+double pairTime(IMemoryManager *manager, size_t n)
+{
+    const size_t sizes[] = {16, 24, 40, 64, 8, 96, 32, 48};
+    CMemoryManagerSwitcher switcher(manager);
+    std::vector<void*> blocks(64);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i += blocks.size())
+    {
+        for (size_t j = 0; j < blocks.size(); ++j)
+            blocks[j] = ::operator new(sizes[j % 8]);
+        for (size_t j = 0; j < blocks.size(); ++j)
+            ::operator delete(blocks[j], sizes[j % 8]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / n;
+}
+
+
+int main()
+{
+    size_t n;
+    std::cin >> n;
+    for (bool headerless : {true, false})
+    {
+        SlabManager direct(headerless);
+        DynamicSlabManager dynamic(headerless);
+        pairTime(&direct, n / 10);
+        pairTime(&dynamic, n / 10);
+        std::cout << (headerless ? "Headerless" : "With a header") << ":\n"
+                  << "  virtual calls:\t" << pairTime(&dynamic, n) << " ns per new and delete\n"
+                  << "  static calls:\t\t" << pairTime(&direct, n) << " ns per new and delete\n";
+        assert(direct.slabsNum() <= SizeClasses::NUM && dynamic.slabsNum() <= SizeClasses::NUM);
+    }
+    return 0;
+}
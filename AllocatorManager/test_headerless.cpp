@@ -0,0 +1,77 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include "CachingManager.h"
+# include <list>
+# include <set>
+# include <chrono>
+# include <cstdio>
+# include <string>
+# include <sys/wait.h>
+# include <unistd.h>
+
+
+size_t residentKib()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (statm != nullptr)
+    {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Keeps n small nodes alive at once and reports how much resident memory they
+// took. Each run is forked, so that no run reuses memory another one freed.
+// args go to the constructor of the manager.
+template<typename Container, typename Manager, typename... Args>
+void measure(const std::string &name, size_t n, Args... args)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    Manager manager(args...);
+    size_t before = residentKib();
+    auto begin = std::chrono::steady_clock::now();
+    {
+        CMemoryManagerSwitcher switcher(&manager);
+        Container c;
+        for (size_t i = 0; i < n; ++i)
+            c.insert(c.end(), static_cast<int>(i));
+        size_t after = residentKib();
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "  " << name << ":\t" << (after - before) * 1024.0 / n << " bytes per node, "
+                  << std::chrono::duration<double, std::nano>(end - begin).count() / n << " ns per insert\n";
+    }
+    std::cout.flush();
+    _exit(0);
+}
+
+template<typename Container>
+void compare(const std::string &container, size_t n)
+{
+    std::cout << container << " of " << n << " ints:\n";
+    measure<Container, DefaultManager>("DefaultManager, header", n);
+    measure<Container, SlabManager>("SlabManager, header", n, false);
+    measure<Container, SlabManager>("SlabManager, headerless", n, true);
+    measure<Container, CachingManager>("CachingManager, header", n, false);
+    measure<Container, CachingManager>("CachingManager, headerless", n, true);
+}
+
+
+int main()
+{
+    size_t n;
+    std::cin >> n;
+    compare<std::list<int> >("std::list", n);
+    compare<std::set<int> >("std::set", n);
+    return 0;
+}
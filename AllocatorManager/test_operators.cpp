@@ -0,0 +1,113 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "StackAllocator.h"
+# include "SlabManager.h"
+# include "CachingManager.h"
+# include <atomic>
+# include <vector>
+# include <chrono>
+# include <cassert>
+# include <cstdint>
+# include <string>
+# include <random>
+# include <algorithm>
+
+// Over-aligned new needs C++17: g++ -std=c++17 -O2 -pthread test_operators.cpp
+
+struct alignas(64) PaddedCounter
+{
+    std::atomic<long> value;
+};
+
+struct alignas(4096) Page
+{
+    char data[4096];
+};
+
+template<typename T>
+void checkAligned(const T *ptr)
+{
+    assert(reinterpret_cast<uintptr_t>(ptr) % alignof(T) == 0);
+}
+
+// Goes through every overload of the family with the manager installed.
+void exercise(IMemoryManager *manager)
+{
+    CMemoryManagerSwitcher switcher(manager);
+    std::vector<void*> small;
+    for (size_t i = 1; i < 300; i += 7)
+        small.push_back(::operator new(i));
+    PaddedCounter *counter = new PaddedCounter();
+    checkAligned(counter);
+    PaddedCounter *counters = new PaddedCounter[7];
+    for (size_t i = 0; i < 7; ++i)
+        checkAligned(counters + i);
+    Page *page = new Page();
+    checkAligned(page);
+    int *number = new(std::nothrow) int(42);
+    assert(*number == 42);
+    std::string *strings = new std::string[3];
+    std::vector<PaddedCounter> vector(100);
+    checkAligned(vector.data());
+    delete[] strings;
+    delete number;
+    delete page;
+    delete[] counters;
+    delete counter;
+    for (size_t i = 0; i < small.size(); ++i)
+        ::operator delete(small[i], 1 + 7 * i);
+    delete static_cast<int*>(nullptr);
+}
+
+// Frees n blocks of the given size in random order with sized or unsized delete.
+double freeTime(IMemoryManager *manager, size_t n, size_t size, bool sized)
+{
+    CMemoryManagerSwitcher switcher(manager);
+    std::vector<void*> blocks(n);
+    std::mt19937 gen(42);
+    double total = 0;
+    for (int round = 0; round < 10; ++round)
+    {
+        for (void *&block : blocks)
+            block = ::operator new(size);
+        std::shuffle(blocks.begin(), blocks.end(), gen);
+        auto begin = std::chrono::steady_clock::now();
+        for (void *block : blocks)
+        {
+            if (sized)
+                ::operator delete(block, size);
+            else
+                ::operator delete(block);
+        }
+        auto end = std::chrono::steady_clock::now();
+        total += std::chrono::duration<double, std::nano>(end - begin).count();
+    }
+    return total / (10 * n);
+}
+
+
+int main()
+{
+    size_t n;
+    std::cin >> n;
+    DefaultManager heap;
+    manager::StackAllocator stack;
+    SlabManager slabs, headed_slabs(false);
+    CachingManager caches, headed_caches(false);
+    exercise(nullptr);
+    exercise(&heap);
+    exercise(&stack);
+    exercise(&slabs);
+    exercise(&headed_slabs);
+    exercise(&caches);
+    exercise(&headed_caches);
+    std::cout << "Every overload returns aligned memory to every manager\n";
+    for (size_t size : {16, 48, 200})
+    {
+        std::cout << "Freeing " << n << " blocks of " << size << " bytes from CachingManager:\n"
+                  << "  unsized delete:\t" << freeTime(&caches, n, size, false) << " ns per block\n"
+                  << "  sized delete:\t\t" << freeTime(&caches, n, size, true) << " ns per block\n";
+    }
+    return 0;
+}
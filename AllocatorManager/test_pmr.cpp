@@ -0,0 +1,154 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include "CachingManager.h"
+# include "TlsfManager.h"
+# include "StackAllocator.h"
+# include "MemoryResource.h"
+# include <memory_resource>
+# include <vector>
+# include <list>
+# include <chrono>
+# include <cstdio>
+# include <cassert>
+# include <string>
+# include <functional>
+# include <sys/wait.h>
+# include <unistd.h>
+
+
+struct Times
+{
+    double vector_ns, list_ns;
+};
+
+// Every round fills a vector and a list of n elements and sums them, then
+// calls release, which a monotonic resource needs to get its memory back.
+template<typename Vector, typename List>
+Times fill(const std::function<Vector()> &makeVector, const std::function<List()> &makeList,
+           const std::function<void()> &release, size_t n, size_t rounds)
+{
+    double vector_ns = 0, list_ns = 0;
+    long long expected = static_cast<long long>(n) * (n - 1) / 2;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        {
+            Vector vector = makeVector();
+            for (size_t i = 0; i < n; ++i)
+                vector.push_back(i);
+            long long sum = 0;
+            for (long long value : vector)
+                sum += value;
+            assert(sum == expected);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        {
+            List list = makeList();
+            for (size_t i = 0; i < n; ++i)
+                list.push_back(i);
+            long long sum = 0;
+            for (long long value : list)
+                sum += value;
+            assert(sum == expected);
+        }
+        auto end = std::chrono::steady_clock::now();
+        release();
+        vector_ns += std::chrono::duration<double, std::nano>(middle - begin).count();
+        list_ns += std::chrono::duration<double, std::nano>(end - middle).count();
+    }
+    return Times{vector_ns / (n * rounds), list_ns / (n * rounds)};
+}
+
+Times pmrFill(std::pmr::memory_resource *resource, const std::function<void()> &release, size_t n, size_t rounds)
+{
+    return fill<std::pmr::vector<long long>, std::pmr::list<long long> >(
+        [resource]() { return std::pmr::vector<long long>(resource); },
+        [resource]() { return std::pmr::list<long long>(resource); }, release, n, rounds);
+}
+
+// Plain containers through operator new, with the manager installed.
+Times switchedFill(IMemoryManager *manager, size_t n, size_t rounds)
+{
+    CMemoryManagerSwitcher switcher(manager);
+    return fill<std::vector<long long>, std::list<long long> >(
+        []() { return std::vector<long long>(); }, []() { return std::list<long long>(); }, []() {}, n, rounds);
+}
+
+// Each resource runs in a process of its own, so that none inherits the heap
+// another left.
+void report(const std::string &name, const std::function<Times()> &body)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    Times times = body();
+    std::printf("  %-36s vector %6.2f ns, list %6.2f ns per element\n", name.c_str(), times.vector_ns,
+                times.list_ns);
+    std::fflush(stdout);
+    _exit(0);
+}
+
+
+int main()
+{
+    size_t n, rounds;
+    std::cin >> n >> rounds;
+    auto nothing = []() {};
+    std::cout << "pmr containers of " << n << " elements:\n";
+    report("new_delete_resource", [&]() {
+        return pmrFill(std::pmr::new_delete_resource(), nothing, n, rounds);
+    });
+    report("unsynchronized_pool_resource", [&]() {
+        std::pmr::unsynchronized_pool_resource pool;
+        return pmrFill(&pool, nothing, n, rounds);
+    });
+    report("monotonic_buffer_resource", [&]() {
+        std::pmr::monotonic_buffer_resource monotonic;
+        return pmrFill(&monotonic, [&monotonic]() { monotonic.release(); }, n, rounds);
+    });
+    report("ManagerResource(DefaultManager)", [&]() {
+        DefaultManager manager;
+        ManagerResource resource(&manager);
+        return pmrFill(&resource, nothing, n, rounds);
+    });
+    report("ManagerResource(SlabManager)", [&]() {
+        SlabManager manager;
+        ManagerResource resource(&manager);
+        return pmrFill(&resource, nothing, n, rounds);
+    });
+    report("ManagerResource(CachingManager)", [&]() {
+        CachingManager manager;
+        ManagerResource resource(&manager);
+        return pmrFill(&resource, nothing, n, rounds);
+    });
+    report("ManagerResource(TlsfManager)", [&]() {
+        TlsfManager manager;
+        ManagerResource resource(&manager);
+        return pmrFill(&resource, nothing, n, rounds);
+    });
+    report("StackResource", [&]() {
+        manager::StackAllocator arena;
+        StackResource resource(arena);
+        return pmrFill(&resource, [&resource]() { resource.release(); }, n, rounds);
+    });
+    std::cout << "std containers with the manager installed:\n";
+    report("DefaultManager", [&]() {
+        DefaultManager manager;
+        return switchedFill(&manager, n, rounds);
+    });
+    report("ResourceManager(pool_resource)", [&]() {
+        // The pool must not take its chunks from operator new it serves.
+        DefaultManager heap;
+        ManagerResource upstream(&heap);
+        std::pmr::unsynchronized_pool_resource pool(&upstream);
+        ResourceManager manager(&pool);
+        return switchedFill(&manager, n, rounds);
+    });
+    return 0;
+}
@@ -0,0 +1,83 @@
+# include <iostream>
+# include "AllocatorStrategy.h"
+# include <random>
+# include <vector>
+# include <thread>
+# include <chrono>
+# include <cassert>
+
+
+// A tree node, the kind of object allocated by the million.
+struct NodeData
+{
+    long key;
+    NodeData *left, *right;
+    int height;
+};
+
+struct HeapNode : NodeData, CAllocatedOn<RuntimeHeap> {};
+
+struct SharedNode : NodeData, CAllocatedOn<PoolStrategy<SharedNode, false> > {};
+
+struct PooledNode : NodeData, CAllocatedOn<PoolStrategy<PooledNode> > {};
+
+// Keeps `live` nodes and replaces a random one on every step.
+template<typename Node>
+long long churn(size_t live, size_t steps, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::vector<Node*> nodes(live, nullptr);
+    long long checksum = 0;
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t pos = gen() % live;
+        if (nodes[pos] != nullptr)
+        {
+            checksum += nodes[pos]->key;
+            delete nodes[pos];
+        }
+        nodes[pos] = new Node();
+        nodes[pos]->key = i;
+    }
+    for (Node *node : nodes)
+        delete node;
+    return checksum;
+}
+
+// Nanoseconds per new and delete pair, every thread churning on its own.
+template<typename Node>
+double pairTime(size_t threads_num, size_t live, size_t steps, long long expected)
+{
+    std::vector<std::thread> threads;
+    std::vector<long long> checksums(threads_num);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < threads_num; ++i)
+        threads.emplace_back([&checksums, i, live, steps]() {
+            checksums[i] = churn<Node>(live, steps, 42);
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+    for (long long checksum : checksums)
+        assert(checksum == expected);
+    return std::chrono::duration<double, std::nano>(end - begin).count() / steps;
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    long long expected = churn<HeapNode>(live, steps, 42);
+    for (size_t threads_num : {1, 4})
+    {
+        std::cout << threads_num << " thread(s), " << live << " live nodes:\n"
+                  << "  RuntimeHeap:\t\t\t" << pairTime<HeapNode>(threads_num, live, steps, expected)
+                  << " ns per new and delete\n"
+                  << "  PoolStrategy:\t\t\t" << pairTime<PooledNode>(threads_num, live, steps, expected)
+                  << " ns per new and delete\n"
+                  << "  PoolStrategy, shared:\t\t" << pairTime<SharedNode>(threads_num, live, steps, expected)
+                  << " ns per new and delete\n";
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "ProfilingManager.h"
+# include <random>
+# include <vector>
+# include <string>
+# include <chrono>
+# include <fstream>
+# include <cassert>
+
+
+// Two call sites of different weight, to be told apart in the profile.
+__attribute__((noinline)) char* smallBuffer(std::mt19937 &gen)
+{
+    return new char[16 + gen() % 256];
+}
+
+__attribute__((noinline)) char* largeBuffer(std::mt19937 &gen)
+{
+    return new char[4096 + gen() % 65536];
+}
+
+// Keeps `live` buffers, one in ten of them large, and replaces a random one
+// on every step. Nanoseconds per replacement.
+double churn(IMemoryManager *manager, size_t live, size_t steps)
+{
+    std::mt19937 gen(42);
+    std::vector<char*> buffers(live, nullptr);
+    CMemoryManagerSwitcher switcher(manager);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t pos = gen() % live;
+        delete[] buffers[pos];
+        buffers[pos] = (pos % 10 == 0 ? largeBuffer(gen) : smallBuffer(gen));
+        buffers[pos][0] = 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (char *buffer : buffers)
+        delete[] buffer;
+    return std::chrono::duration<double, std::nano>(end - begin).count() / steps;
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    DefaultManager heap;
+    std::cout << "DefaultManager:\t\t\t\t" << churn(&heap, live, steps) << " ns per replacement\n";
+    for (size_t sample_bytes : {size_t(1), size_t(64) << 10, size_t(512) << 10})
+    {
+        ProfilingManager profiler(&heap, sample_bytes);
+        std::cout << "ProfilingManager, every " << sample_bytes << " bytes:\t" << churn(&profiler, live, steps)
+                  << " ns per replacement\n";
+        // Everything was freed by the end of the run.
+        assert(profiler.stats().live_bytes == 0);
+        assert(profiler.stats().allocs == profiler.stats().frees);
+    }
+    // A profile of one scope, the rest of the program is not counted.
+    ProfilingManager profiler(&heap);
+    churn(&profiler, live, steps);
+    profiler.dumpText(std::cout);
+    std::ofstream out("test_profile.heap");
+    profiler.dumpHeap(out);
+    std::cout << "Heap profile written to test_profile.heap, see pprof --text <binary> test_profile.heap\n";
+    return 0;
+}
@@ -0,0 +1,52 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "RecordingManager.h"
+# include <random>
+# include <map>
+# include <string>
+# include <vector>
+# include <list>
+# include <thread>
+
+
+// Something closer to a service than one container in a loop: an index of
+// strings to growing vectors, a queue of requests with payloads of various
+// sizes, and entries dropped from the index now and then.
+void serve(size_t requests, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::map<std::string, std::vector<int> > index;
+    std::list<std::string> queue;
+    for (size_t i = 0; i < requests; ++i)
+    {
+        std::string key = "key" + std::to_string(gen() % 4096);
+        index[key].push_back(i);
+        queue.push_back(std::string(16 + gen() % 2048, 'x'));
+        if (queue.size() > 256)
+            queue.pop_front();
+        if (gen() % 16 == 0)
+            index.erase(index.begin());
+    }
+}
+
+
+int main()
+{
+    size_t requests, threads_num;
+    std::cin >> requests >> threads_num;
+    DefaultManager heap;
+    {
+        RecordingManager recorder(&heap, "test_record.trace");
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threads_num; ++i)
+            threads.emplace_back([&recorder, requests, i]() {
+                CMemoryManagerSwitcher switcher(&recorder);
+                serve(requests, 42 + i);
+            });
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+    std::cout << "Trace written to test_record.trace, replay it with replay.cpp\n";
+    return 0;
+}
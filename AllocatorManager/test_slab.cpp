@@ -0,0 +1,62 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include <random>
+# include <vector>
+# include <chrono>
+# include <cassert>
+# include <cstring>
+
+
+// Keeps `live` objects of random sizes and replaces a random one on every step,
+// which is the pattern of a long-lived subsystem with short-lived requests.
+long long churn(IMemoryManager *manager, size_t live, size_t steps, size_t max_size)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> sizes(1, max_size);
+    std::vector<char*> objects(live, nullptr);
+    std::vector<size_t> lengths(live, 0);
+    long long checksum = 0;
+    CMemoryManagerSwitcher switcher(manager);
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t pos = gen() % live;
+        if (objects[pos] != nullptr)
+        {
+            checksum += objects[pos][lengths[pos] - 1];
+            delete[] objects[pos];
+        }
+        lengths[pos] = sizes(gen);
+        objects[pos] = new char[lengths[pos]];
+        std::memset(objects[pos], static_cast<char>(i), lengths[pos]);
+    }
+    for (char *object : objects)
+        delete[] object;
+    return checksum;
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    for (size_t max_size : {64, 512, 4096})
+    {
+        std::cout << "Objects up to " << max_size << " bytes:\n";
+        DefaultManager heap;
+        auto begin = std::chrono::steady_clock::now();
+        long long expected = churn(&heap, live, steps, max_size);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "  DefaultManager:\t" << std::chrono::duration<double, std::nano>(end - begin).count() / steps
+                  << " ns per step\n";
+        SlabManager slabs;
+        begin = std::chrono::steady_clock::now();
+        long long checksum = churn(&slabs, live, steps, max_size);
+        end = std::chrono::steady_clock::now();
+        assert(checksum == expected);
+        std::cout << "  SlabManager:\t\t" << std::chrono::duration<double, std::nano>(end - begin).count() / steps
+                  << " ns per step, " << slabs.slabsNum() << " slabs left after freeing everything\n";
+    }
+    return 0;
+}
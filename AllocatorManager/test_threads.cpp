@@ -0,0 +1,160 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include "CachingManager.h"
+# include "StackAllocator.h"
+# include <random>
+# include <vector>
+# include <deque>
+# include <chrono>
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <cassert>
+# include <memory>
+# include <type_traits>
+
+
+// Managers that every thread may allocate from at once. The others get one
+// instance per thread.
+template<typename Manager>
+struct IsShared : std::false_type {};
+
+template<>
+struct IsShared<CachingManager> : std::true_type {};
+
+// The shared manager is made here. The others are left to the thread that
+// uses them, as a SlabManager only allocates on the thread that made it; they
+// live until the end of the run, for the frees of other threads.
+template<typename Manager>
+std::vector<std::unique_ptr<Manager> > makeManagers(size_t threads_num)
+{
+    std::vector<std::unique_ptr<Manager> > managers(IsShared<Manager>::value ? 1 : threads_num);
+    if (IsShared<Manager>::value)
+        managers[0].reset(new Manager());
+    return managers;
+}
+
+template<typename Manager>
+Manager* threadManager(std::vector<std::unique_ptr<Manager> > &managers, size_t t)
+{
+    std::unique_ptr<Manager> &manager = managers[t % managers.size()];
+    if (!manager)
+        manager.reset(new Manager());
+    return manager.get();
+}
+
+
+// Every thread churns through small objects.
+template<typename Manager>
+double privateChurn(size_t threads_num, size_t live, size_t steps)
+{
+    auto managers = makeManagers<Manager>(threads_num);
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_num; ++t)
+    {
+        threads.emplace_back([&managers, live, steps, t]()
+        {
+            CMemoryManagerSwitcher switcher(threadManager(managers, t));
+            std::mt19937 gen(t);
+            std::vector<std::unique_ptr<char[]> > objects(live);
+            for (size_t i = 0; i < steps; ++i)
+                objects[gen() % live].reset(new char[1 + gen() % 128]);
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (threads_num * steps);
+}
+
+
+struct Channel
+{
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::vector<char*>*> queue;
+};
+
+
+// Producers allocate batches, each consumer frees the batches of its
+// producer, so every Free arrives from a thread that did not allocate.
+template<typename Manager>
+double handOff(size_t pairs, size_t batches, size_t batch_size)
+{
+    auto managers = makeManagers<Manager>(pairs);
+    std::vector<Channel> channels(pairs);
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < pairs; ++p)
+    {
+        Channel &channel = channels[p];
+        threads.emplace_back([&managers, p, &channel, batches, batch_size]()
+        {
+            Manager *manager = threadManager(managers, p);
+            for (size_t b = 0; b <= batches; ++b)
+            {
+                std::vector<char*> *batch = nullptr;
+                if (b < batches)
+                {
+                    // Only the batch comes from the manager: the queue must
+                    // not, it outlives the producer.
+                    CMemoryManagerSwitcher switcher(manager);
+                    batch = new std::vector<char*>(batch_size);
+                    for (char *&object : *batch)
+                        object = new char[16 + b % 64];
+                }
+                std::unique_lock<std::mutex> lock(channel.mutex);
+                channel.ready.wait(lock, [&channel]() { return channel.queue.size() < 16; });
+                channel.queue.push_back(batch);
+                channel.ready.notify_all();
+            }
+        });
+        threads.emplace_back([&channel]()
+        {
+            while (true)
+            {
+                std::unique_lock<std::mutex> lock(channel.mutex);
+                channel.ready.wait(lock, [&channel]() { return !channel.queue.empty(); });
+                std::vector<char*> *batch = channel.queue.front();
+                channel.queue.pop_front();
+                channel.ready.notify_all();
+                if (batch == nullptr)
+                    return;
+                lock.unlock();
+                for (char *object : *batch)
+                    delete[] object;
+                delete batch;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (pairs * batches * batch_size);
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    for (size_t threads_num : {1, 2, 4, 8})
+    {
+        std::cout << threads_num << " threads churning:\n"
+                  << "  DefaultManager:\t\t" << privateChurn<DefaultManager>(threads_num, live, steps) << " ns per step\n"
+                  << "  SlabManager per thread:\t" << privateChurn<SlabManager>(threads_num, live, steps) << " ns per step\n"
+                  << "  StackAllocator per thread:\t" << privateChurn<manager::StackAllocator>(threads_num, live, steps) << " ns per step\n"
+                  << "  Shared CachingManager:\t" << privateChurn<CachingManager>(threads_num, live, steps) << " ns per step\n";
+    }
+    for (size_t pairs : {1, 2, 4})
+    {
+        std::cout << pairs << " producer/consumer pairs:\n"
+                  << "  DefaultManager:\t\t" << handOff<DefaultManager>(pairs, steps / 1000, 1000) << " ns per object\n"
+                  << "  SlabManager per producer:\t" << handOff<SlabManager>(pairs, steps / 1000, 1000) << " ns per object\n"
+                  << "  Shared CachingManager:\t" << handOff<CachingManager>(pairs, steps / 1000, 1000) << " ns per object\n";
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+# include <iostream>
+# include "MemoryManager.h"
+# include "MemoryManager.cpp"
+# include "SlabManager.h"
+# include "TlsfManager.h"
+# include <random>
+# include <vector>
+# include <chrono>
+# include <algorithm>
+# include <cstdio>
+# include <cstring>
+# include <cmath>
+# include <string>
+# include <sys/wait.h>
+# include <unistd.h>
+
+
+// Keeps `live` buffers of log-uniform sizes up to max_size and replaces a
+// random one on every step, timing every operator new on its own.
+std::vector<double> latencies(IMemoryManager *manager, size_t live, size_t steps, size_t max_size)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> exponent(std::log(16.0), std::log(static_cast<double>(max_size)));
+    std::vector<char*> buffers(live, nullptr);
+    std::vector<double> result;
+    result.reserve(steps);
+    CMemoryManagerSwitcher switcher(manager);
+    for (size_t i = 0; i < steps; ++i)
+    {
+        size_t pos = gen() % live;
+        delete[] buffers[pos];
+        size_t size = static_cast<size_t>(std::exp(exponent(gen)));
+        auto begin = std::chrono::steady_clock::now();
+        buffers[pos] = new char[size];
+        auto end = std::chrono::steady_clock::now();
+        result.push_back(std::chrono::duration<double, std::nano>(end - begin).count());
+        std::memset(buffers[pos], 1, size);
+    }
+    for (char *buffer : buffers)
+        delete[] buffer;
+    return result;
+}
+
+double percentile(std::vector<double> &values, double share)
+{
+    size_t pos = std::min(values.size() - 1, static_cast<size_t>(share * values.size()));
+    std::nth_element(values.begin(), values.begin() + pos, values.end());
+    return values[pos];
+}
+
+// Each manager runs in a process of its own, so that none inherits the heap
+// another left.
+template<typename Manager>
+void report(const std::string &name, size_t live, size_t steps, size_t max_size)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    Manager manager;
+    std::vector<double> values = latencies(&manager, live, steps, max_size);
+    std::printf("  %-16s median %6.0f ns, p99 %7.0f ns, p99.99 %8.0f ns, worst %9.0f ns\n", name.c_str(),
+                percentile(values, 0.5), percentile(values, 0.99), percentile(values, 0.9999),
+                *std::max_element(values.begin(), values.end()));
+    std::fflush(stdout);
+    _exit(0);
+}
+
+
+int main()
+{
+    size_t live, steps;
+    std::cin >> live >> steps;
+    for (size_t max_size : {256, 4096, 65536})
+    {
+        std::cout << "Allocations of up to " << max_size << " bytes, " << live << " live:\n";
+        report<DefaultManager>("DefaultManager", live, steps, max_size);
+        report<SlabManager>("SlabManager", live, steps, max_size);
+        report<TlsfManager>("TlsfManager", live, steps, max_size);
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+# pragma once
+# include "XorList.h"
+# include <algorithm>
+# include <stdexcept>
+# include <vector>
+
+// XorList with a sparse positional index: every step-th element or so is
+// remembered as a checkpoint, so that reaching position i takes O(step + n / step)
+// instead of O(i). Positional insert and erase keep the index up to date.
+template<typename T, typename Allocator = std::allocator<T> >
+class IndexedXorList
+{
+public:
+    typedef typename XorList<T, Allocator>::iterator iterator;
+    typedef typename XorList<T, Allocator>::reverse_iterator reverse_iterator;
+
+    explicit IndexedXorList(size_t step = DEFAULT_STEP, const Allocator &alloc = Allocator()):
+        list_(alloc), step_(std::max<size_t>(step, 1)) {}
+
+    size_t size() const
+    {
+        return list_.size();
+    }
+
+    bool empty() const
+    {
+        return list_.empty();
+    }
+
+    size_t step() const
+    {
+        return step_;
+    }
+
+    const XorList<T, Allocator>& list() const
+    {
+        return list_;
+    }
+
+    template<typename U>
+    void push_back(U&& value)
+    {
+        insert(size(), std::forward<U>(value));
+    }
+
+    template<typename U>
+    void push_front(U&& value)
+    {
+        insert(0, std::forward<U>(value));
+    }
+
+    void pop_back()
+    {
+        erase(size() - 1);
+    }
+
+    void pop_front()
+    {
+        erase(0);
+    }
+
+    template<typename U>
+    iterator insert(size_t pos, U&& value)
+    {
+        iterator it = list_.insert_before(nth(pos), std::forward<U>(value));
+        afterInsert(pos, it);
+        return it;
+    }
+
+    iterator erase(size_t pos)
+    {
+        iterator it = list_.erase(nth(pos));
+        afterErase(pos, it);
+        return it;
+    }
+
+    void clear()
+    {
+        list_.clear();
+        checkpoints_.clear();
+    }
+
+    iterator nth(size_t pos) const
+    {
+        auto upper = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), pos,
+            [](size_t value, const Checkpoint &checkpoint) { return value < checkpoint.pos; });
+        size_t low_pos = 0, high_pos = size();
+        iterator it = begin();
+        if (upper != checkpoints_.begin())
+        {
+            low_pos = std::prev(upper)->pos;
+            it = std::prev(upper)->it;
+        }
+        if (upper != checkpoints_.end())
+            high_pos = upper->pos;
+        if (pos - low_pos <= high_pos - pos)
+            return std::next(it, pos - low_pos);
+        it = (upper != checkpoints_.end() ? upper->it : end());
+        return std::prev(it, high_pos - pos);
+    }
+
+    T& operator[](size_t pos)
+    {
+        return *nth(pos);
+    }
+
+    const T& operator[](size_t pos) const
+    {
+        return *nth(pos);
+    }
+
+    T& at(size_t pos)
+    {
+        if (pos >= size())
+            throw std::out_of_range("IndexedXorList::at");
+        return *nth(pos);
+    }
+
+    const T& at(size_t pos) const
+    {
+        if (pos >= size())
+            throw std::out_of_range("IndexedXorList::at");
+        return *nth(pos);
+    }
+
+    iterator begin() const
+    {
+        return list_.begin();
+    }
+
+    iterator end() const
+    {
+        return list_.end();
+    }
+
+    reverse_iterator rbegin() const
+    {
+        return list_.rbegin();
+    }
+
+    reverse_iterator rend() const
+    {
+        return list_.rend();
+    }
+private:
+    struct Checkpoint
+    {
+        size_t pos;
+        iterator it;
+    };
+
+    XorList<T, Allocator> list_;
+    std::vector<Checkpoint> checkpoints_;
+    size_t step_;
+    static const size_t DEFAULT_STEP = 64;
+
+    size_t firstNotBefore(size_t pos) const
+    {
+        return std::lower_bound(checkpoints_.begin(), checkpoints_.end(), pos,
+            [](const Checkpoint &checkpoint, size_t value) { return checkpoint.pos < value; })
+            - checkpoints_.begin();
+    }
+
+    // it points to the element just inserted at pos. The checkpoint that sat
+    // at pos kept the old neighbours, so it is moved past the new element.
+    void afterInsert(size_t pos, const iterator &it)
+    {
+        size_t idx = firstNotBefore(pos);
+        if (idx < checkpoints_.size() && checkpoints_[idx].pos == pos)
+            checkpoints_[idx].it = std::next(it);
+        for (size_t i = idx; i < checkpoints_.size(); ++i)
+            ++checkpoints_[i].pos;
+        size_t low_pos = (idx > 0 ? checkpoints_[idx - 1].pos : 0);
+        size_t high_pos = (idx < checkpoints_.size() ? checkpoints_[idx].pos : size());
+        if (high_pos - low_pos > 2 * step_)
+        {
+            iterator low = (idx > 0 ? checkpoints_[idx - 1].it : begin());
+            checkpoints_.insert(checkpoints_.begin() + idx,
+                Checkpoint{low_pos + step_, std::next(low, step_)});
+        }
+    }
+
+    // it points to the element that took the place of the erased one. Both the
+    // checkpoint on the erased element and the one right after it are stale.
+    void afterErase(size_t pos, const iterator &it)
+    {
+        size_t idx = firstNotBefore(pos);
+        size_t stale = idx;
+        while (stale < checkpoints_.size() && checkpoints_[stale].pos <= pos + 1)
+            ++stale;
+        checkpoints_.erase(checkpoints_.begin() + idx, checkpoints_.begin() + stale);
+        if (stale != idx && it != end())
+            checkpoints_.insert(checkpoints_.begin() + idx, Checkpoint{pos, it});
+        for (size_t i = idx; i < checkpoints_.size(); ++i)
+        {
+            if (checkpoints_[i].pos > pos)
+                --checkpoints_[i].pos;
+        }
+        if (idx >= checkpoints_.size())
+            return;
+        size_t low_pos = (idx > 0 ? checkpoints_[idx - 1].pos : 0);
+        size_t high_pos = (idx + 1 < checkpoints_.size() ? checkpoints_[idx + 1].pos : size());
+        if (high_pos - low_pos <= step_)
+            checkpoints_.erase(checkpoints_.begin() + idx);
+    }
+};
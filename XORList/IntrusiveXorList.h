@@ -0,0 +1,239 @@
+# pragma once
+# include <cstdint>
+# include <cstddef>
+# include <iterator>
+# include <utility>
+
+class XorHook
+{
+public:
+    template<typename T, XorHook T::*Hook>
+    friend class IntrusiveXorList;
+
+    XorHook() : xor_(0) {}
+
+    // Links belong to the list, not to the value: copies start unlinked.
+    XorHook(const XorHook &) : xor_(0) {}
+
+    XorHook& operator=(const XorHook &)
+    {
+        return *this;
+    }
+
+    ~XorHook() = default;
+private:
+    uintptr_t xor_;
+};
+
+template<typename T, XorHook T::*Hook>
+class IntrusiveXorList
+{
+public:
+    class iterator : public std::iterator<std::bidirectional_iterator_tag, T>
+    {
+        friend IntrusiveXorList;
+    public:
+        explicit iterator(T *prev = nullptr, T *curr = nullptr):
+            prev_(prev), curr_(curr) {}
+
+        iterator(const iterator &other) = default;
+
+        ~iterator() = default;
+
+        T& operator*() const
+        {
+            return *curr_;
+        }
+
+        T* operator->() const
+        {
+            return curr_;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            return (curr_ == other.curr_);
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+            return !operator==(other);
+        }
+
+        iterator& operator++()
+        {
+            prev_ = next_();
+            std::swap(prev_, curr_);
+            return *this;
+        }
+
+        iterator& operator--()
+        {
+            curr_ = getPtrNum(getXor(prev_) ^ getNumPtr(curr_));
+            std::swap(prev_, curr_);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator cpy = *this;
+            operator++();
+            return cpy;
+        }
+
+        iterator operator--(int)
+        {
+            iterator cpy = *this;
+            operator--();
+            return cpy;
+        }
+    private:
+        T *prev_, *curr_;
+
+        T* next_() const
+        {
+            return getPtrNum(getNumPtr(prev_) ^ getXor(curr_));
+        }
+    };
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    IntrusiveXorList() : first_(nullptr), last_(nullptr), size_(0) {}
+
+    IntrusiveXorList(const IntrusiveXorList &other) = delete;
+
+    IntrusiveXorList(IntrusiveXorList&& other) noexcept
+    : first_(other.first_), last_(other.last_), size_(other.size_)
+    {
+        other.first_ = nullptr;
+        other.last_ = nullptr;
+        other.size_ = 0;
+    }
+
+    IntrusiveXorList& operator=(const IntrusiveXorList &other) = delete;
+
+    IntrusiveXorList& operator=(IntrusiveXorList&& other) noexcept
+    {
+        std::swap(first_, other.first_);
+        std::swap(last_, other.last_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ~IntrusiveXorList() = default;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    void push_back(T &value)
+    {
+        insert_before(end(), value);
+    }
+
+    void push_front(T &value)
+    {
+        insert_before(begin(), value);
+    }
+
+    void pop_back()
+    {
+        erase(--end());
+    }
+
+    void pop_front()
+    {
+        erase(begin());
+    }
+
+    iterator insert_before(const iterator &it, T &value)
+    {
+        ++size_;
+        T *left = it.prev_, *right = it.curr_, *new_elem = &value;
+        (new_elem->*Hook).xor_ = 0;
+        makeLink(left, right);
+        makeLink(left, new_elem);
+        makeLink(new_elem, right);
+        if (left == nullptr)
+            first_ = new_elem;
+        if (right == nullptr)
+            last_ = new_elem;
+        return iterator(left, new_elem);
+    }
+
+    iterator insert_after(iterator it, T &value)
+    {
+        return insert_before(++it, value);
+    }
+
+    iterator erase(const iterator &it)
+    {
+        --size_;
+        T *curr = it.curr_, *left = it.prev_, *right = it.next_();
+        if (left == nullptr)
+            first_ = right;
+        if (right == nullptr)
+            last_ = left;
+        makeLink(left, curr);
+        makeLink(curr, right);
+        makeLink(left, right);
+        return iterator(left, right);
+    }
+
+    void clear()
+    {
+        while (!empty())
+            pop_front();
+    }
+
+    iterator begin() const
+    {
+        return iterator(nullptr, first_);
+    }
+
+    iterator end() const
+    {
+        return iterator(last_, nullptr);
+    }
+
+    reverse_iterator rbegin() const
+    {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() const
+    {
+        return reverse_iterator(begin());
+    }
+private:
+    T *first_, *last_;
+    size_t size_;
+
+    static uintptr_t getNumPtr(T *ptr)
+    {
+        return reinterpret_cast<uintptr_t>(ptr);
+    }
+
+    static T* getPtrNum(uintptr_t addr)
+    {
+        return reinterpret_cast<T*>(addr);
+    }
+
+    static uintptr_t getXor(T *elem)
+    {
+        return (elem->*Hook).xor_;
+    }
+
+    static void makeLink(T *first, T *second)
+    {
+        if (first == nullptr || second == nullptr)
+            return;
+        (first->*Hook).xor_ ^= getNumPtr(second);
+        (second->*Hook).xor_ ^= getNumPtr(first);
+    }
+};
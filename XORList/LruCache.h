@@ -0,0 +1,109 @@
+# pragma once
+# include "XorList.h"
+# include "PoolAllocator.h"
+# include <unordered_map>
+# include <utility>
+
+// The index stores a full XorList iterator, i.e. the entry together with its
+// predecessor. Every relink therefore also refreshes the stored iterators of
+// the entries whose predecessor changed: the old successor and the old front.
+template<typename Key, typename Value, typename Hash = std::hash<Key>,
+         typename Allocator = PoolAllocator<std::pair<Key, Value> > >
+class LruCache
+{
+private:
+    typedef XorList<std::pair<Key, Value>, Allocator> EntryList;
+    typedef typename EntryList::iterator iterator;
+    typedef typename Allocator::template rebind<std::pair<const Key, iterator> >::other IndexAllocType;
+public:
+    explicit LruCache(size_t capacity, const Allocator &alloc = Allocator()):
+        capacity_(std::max<size_t>(capacity, 1)), entries_(alloc),
+        index_(capacity_, Hash(), std::equal_to<Key>(), IndexAllocType(alloc))
+    {
+        entries_.reserve(capacity_);
+    }
+
+    size_t size() const
+    {
+        return entries_.size();
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    bool contains(const Key &key) const
+    {
+        return index_.find(key) != index_.end();
+    }
+
+    Value* get(const Key &key)
+    {
+        auto found = index_.find(key);
+        if (found == index_.end())
+            return nullptr;
+        moveToFront(found->second);
+        return &entries_.begin()->second;
+    }
+
+    template<typename U>
+    void put(const Key &key, U&& value)
+    {
+        auto found = index_.find(key);
+        if (found != index_.end())
+        {
+            found->second->second = std::forward<U>(value);
+            moveToFront(found->second);
+            return;
+        }
+        if (entries_.size() == capacity_)
+            evict();
+        entries_.push_front(std::make_pair(key, std::forward<U>(value)));
+        if (entries_.size() > 1)
+            refresh(std::next(entries_.begin()));
+        index_.emplace(key, entries_.begin());
+    }
+
+    bool erase(const Key &key)
+    {
+        auto found = index_.find(key);
+        if (found == index_.end())
+            return false;
+        iterator it = found->second;
+        index_.erase(found);
+        iterator next = entries_.erase(it);
+        if (next != entries_.end())
+            refresh(next);
+        return true;
+    }
+private:
+    size_t capacity_;
+    EntryList entries_;
+    std::unordered_map<Key, iterator, Hash, std::equal_to<Key>, IndexAllocType> index_;
+
+    void refresh(const iterator &it)
+    {
+        index_.find(it->first)->second = it;
+    }
+
+    void moveToFront(iterator &it)
+    {
+        if (it == entries_.begin())
+            return;
+        iterator prev = std::prev(it), next = std::next(it);
+        bool prev_is_front = (prev == entries_.begin());
+        entries_.splice(entries_.begin(), entries_, it);
+        it = entries_.begin();
+        refresh(std::next(it));
+        if (next != entries_.end())
+            refresh(prev_is_front ? std::next(it, 2) : std::next(prev));
+    }
+
+    void evict()
+    {
+        iterator last = std::prev(entries_.end());
+        index_.erase(last->first);
+        entries_.pop_back();
+    }
+};
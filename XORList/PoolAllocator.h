@@ -0,0 +1,139 @@
+# pragma once
+# include "StackAllocator.h"
+# include <algorithm>
+# include <new>
+
+class MemoryPool : public ReferenceCounter
+{
+public:
+    MemoryPool()
+    {
+        std::fill(free_, free_ + CLASSES_NUM, nullptr);
+    }
+
+    static bool fits(size_t size, size_t alignment)
+    {
+        return size <= MAX_SIZE && alignment <= GRANULARITY;
+    }
+
+    void* allocChunk(size_t size)
+    {
+        size_t cls = classOf(size);
+        FreeChunk *chunk = free_[cls];
+        if (chunk == nullptr)
+            return blocks_.allocMemory<Slot>(cls + 1);
+        free_[cls] = chunk->next;
+        return chunk;
+    }
+
+    void freeChunk(void *ptr, size_t size)
+    {
+        size_t cls = classOf(size);
+        free_[cls] = new(ptr) FreeChunk{free_[cls]};
+    }
+private:
+    static const size_t GRANULARITY = 16;
+    static const size_t MAX_SIZE = 256;
+    static const size_t CLASSES_NUM = MAX_SIZE / GRANULARITY;
+
+    struct FreeChunk
+    {
+        FreeChunk *next;
+    };
+
+    struct alignas(GRANULARITY) Slot
+    {
+        char data[GRANULARITY];
+    };
+
+    MemoryBlocks blocks_;
+    FreeChunk *free_[CLASSES_NUM];
+
+    static size_t classOf(size_t size)
+    {
+        return (std::max<size_t>(size, 1) + GRANULARITY - 1) / GRANULARITY - 1;
+    }
+};
+
+template<typename T>
+class PoolAllocator
+{
+public:
+    template<typename U>
+    friend class PoolAllocator;
+
+    using value_type = T;
+    using pointer = T*;
+    using const_pointer = const T*;
+
+    PoolAllocator()
+    {
+        pool_ = new MemoryPool();
+        pool_->addReference();
+    }
+
+    PoolAllocator(const PoolAllocator &other) : pool_(other.pool_)
+    {
+        pool_->addReference();
+    }
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool_(other.pool_)
+    {
+        pool_->addReference();
+    }
+
+    PoolAllocator& operator=(const PoolAllocator &other)
+    {
+        other.pool_->addReference();
+        release();
+        pool_ = other.pool_;
+        return *this;
+    }
+
+    ~PoolAllocator()
+    {
+        release();
+    }
+
+    template<typename U>
+    struct rebind
+    {
+        using other = PoolAllocator<U>;
+    };
+
+    pointer allocate(size_t n)
+    {
+        if (n == 1 && MemoryPool::fits(sizeof(T), alignof(T)))
+            return static_cast<pointer>(pool_->allocChunk(sizeof(T)));
+        return static_cast<pointer>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(pointer ptr, size_t n)
+    {
+        if (n == 1 && MemoryPool::fits(sizeof(T), alignof(T)))
+            pool_->freeChunk(ptr, sizeof(T));
+        else
+            ::operator delete(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &other) const
+    {
+        return pool_ == other.pool_;
+    }
+
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &other) const
+    {
+        return pool_ != other.pool_;
+    }
+private:
+    MemoryPool *pool_;
+
+    void release()
+    {
+        if (pool_->eraseReference())
+            delete pool_;
+    }
+};
@@ -1,17 +1,106 @@
+# pragma once
 # include <memory>
+# include <algorithm>
+# include <atomic>
+# include <mutex>
+# include <thread>
+# include <new>
+# include <sys/mman.h>
+# include <unistd.h>
+
+// Byte counters of an arena. Tail waste is the free space left in blocks that
+// were abandoned for a new one, alignment waste is the padding std::align added.
+struct ArenaStats
+{
+    size_t requested;
+    size_t reserved;
+    size_t blocks;
+    size_t tail_waste;
+    size_t alignment_waste;
+
+    ArenaStats& operator+=(const ArenaStats &other)
+    {
+        requested += other.requested;
+        reserved += other.reserved;
+        blocks += other.blocks;
+        tail_waste += other.tail_waste;
+        alignment_waste += other.alignment_waste;
+        return *this;
+    }
+};
+
+enum class BlockSource
+{
+    Heap,
+    Mmap,
+    HugePages
+};
+
+// Memory for arena blocks. Mapped blocks are returned to the system as soon as
+// the arena dies; huge page blocks are additionally 2 MiB aligned and marked
+// with MADV_HUGEPAGE, so that traversing a large arena needs few TLB entries.
+class BlockMemory
+{
+public:
+    static size_t roundSize(size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            return size;
+        size_t granularity = HUGE_PAGE_SIZE;
+        if (source == BlockSource::Mmap)
+            granularity = sysconf(_SC_PAGESIZE);
+        return (size + granularity - 1) / granularity * granularity;
+    }
+
+    static char* allocate(size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            return new char[size];
+        size = roundSize(size, source);
+        size_t slack = (source == BlockSource::HugePages ? HUGE_PAGE_SIZE : 0);
+        void *mem = mmap(nullptr, size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw std::bad_alloc();
+        char *begin = static_cast<char*>(mem);
+        if (slack != 0)
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(mem);
+            size_t head = (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+            if (head != 0)
+                munmap(begin, head);
+            if (slack != head)
+                munmap(begin + head + size, slack - head);
+            begin += head;
+# ifdef MADV_HUGEPAGE
+            madvise(begin, size, MADV_HUGEPAGE);
+# endif
+        }
+        return begin;
+    }
+
+    static void free(char *ptr, size_t size, BlockSource source)
+    {
+        if (source == BlockSource::Heap)
+            delete[] ptr;
+        else
+            munmap(ptr, roundSize(size, source));
+    }
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+};
 
 class Block
 {
 public:
 
-    explicit Block(Block *previous = nullptr, size_t size = SIZE):
-        begin_(new char[size]), end_(begin_ + size), 
+    explicit Block(Block *previous = nullptr, size_t size = SIZE, BlockSource source = BlockSource::Heap):
+        begin_(BlockMemory::allocate(size, source)), end_(begin_ + size), 
         curr_(reinterpret_cast<void*>(begin_)),
-        space_(size), prev_(previous) {}
+        space_(size), prev_(previous), source_(source) {}
 
     ~Block()
     {
-        delete[] begin_;
+        BlockMemory::free(begin_, end_ - begin_, source_);
         if (prev_ != nullptr)
             delete prev_;
     }
@@ -23,24 +112,91 @@ public:
         {
             T *result = reinterpret_cast<T*>(curr_);
             curr_ = reinterpret_cast<char*>(curr_) + n * sizeof(T);
-            space_ -= sizeof(T);
+            space_ -= n * sizeof(T);
             return result;
         }
         return nullptr;
     }
+
+    void* position() const
+    {
+        return curr_;
+    }
+
+    size_t size() const
+    {
+        return end_ - begin_;
+    }
+
+    size_t space() const
+    {
+        return space_;
+    }
+
+    void rewind(void *position)
+    {
+        space_ += reinterpret_cast<char*>(curr_) - reinterpret_cast<char*>(position);
+        curr_ = position;
+    }
+
+    Block* detachPrevious()
+    {
+        Block *previous = prev_;
+        prev_ = nullptr;
+        return previous;
+    }
+
+    static const size_t SIZE;
 private:
     char *begin_, *end_;
     void *curr_;
     size_t space_;
     Block *prev_;
-    static const size_t SIZE;
+    BlockSource source_;
 };
 const size_t Block::SIZE = 100000;
 
-class MemoryBlocks
+class ReferenceCounter
 {
 public:
-    MemoryBlocks() : cnt_(0), curr_(nullptr) {}
+    ReferenceCounter() : cnt_(0) {}
+
+    void addReference()
+    {
+        cnt_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true when the last reference has gone.
+    bool eraseReference()
+    {
+        return cnt_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    size_t getReferencesNum() const
+    {
+        return cnt_.load(std::memory_order_acquire);
+    }
+
+    bool needDestruct() const
+    {
+        return getReferencesNum() == 0;
+    }
+private:
+    std::atomic<size_t> cnt_;
+};
+
+// Single-threaded arena: nothing on the allocation path is synchronized.
+class MemoryBlocks : public ReferenceCounter
+{
+public:
+    struct Marker
+    {
+        Block *block;
+        void *position;
+        ArenaStats stats;
+    };
+
+    explicit MemoryBlocks(BlockSource source = BlockSource::Heap) : curr_(nullptr), source_(source), stats_() {}
 
     ~MemoryBlocks()
     {
@@ -48,53 +204,282 @@ public:
             delete curr_;
     }
 
-    void addReference()
+    template<typename T>
+    T* allocMemory(size_t n)
     {
-        ++cnt_;
+        if (curr_ != nullptr)
+        {
+            T *result = allocFromCurrent<T>(n);
+            if (result != nullptr)
+                return result;
+            stats_.tail_waste += curr_->space();
+        }
+        addBlock(std::max(Block::SIZE, n * sizeof(T) + alignof(T)));
+        return allocFromCurrent<T>(n);
     }
 
-    void eraseReference()
+    const ArenaStats& stats() const
     {
-        --cnt_;
+        return stats_;
     }
 
-    size_t getReferencesNum() const
+    Marker mark() const
     {
-        return cnt_;
+        return Marker{curr_, curr_ == nullptr ? nullptr : curr_->position(), stats_};
     }
 
-    bool needDestruct() const
+    // Frees every block added after the marker was taken and moves the bump
+    // pointer back. Markers must be rewound in LIFO order.
+    void rewind(const Marker &marker)
     {
-        return cnt_ == 0;
+        while (curr_ != marker.block)
+        {
+            Block *previous = curr_->detachPrevious();
+            delete curr_;
+            curr_ = previous;
+        }
+        if (curr_ != nullptr)
+            curr_->rewind(marker.position);
+        stats_ = marker.stats;
     }
+private:
+    Block *curr_;
+    BlockSource source_;
+    ArenaStats stats_;
 
     template<typename T>
-    T* allocMemory(size_t n)
+    T* allocFromCurrent(size_t n)
     {
-        if (curr_ == nullptr)
-            addBlock();
+        size_t space = curr_->space();
         T *result = curr_->allocAligned<T>(n);
         if (result != nullptr)
-            return result;
-        addBlock();
-        return curr_->allocAligned<T>(n);
+        {
+            stats_.requested += n * sizeof(T);
+            stats_.alignment_waste += space - curr_->space() - n * sizeof(T);
+        }
+        return result;
+    }
+
+    void addBlock(size_t size)
+    {
+        size = BlockMemory::roundSize(size, source_);
+        curr_ = new Block(curr_, size, source_);
+        stats_.reserved += size;
+        ++stats_.blocks;
+    }
+};
+
+class ConcurrentBlock
+{
+public:
+    explicit ConcurrentBlock(ConcurrentBlock *previous = nullptr, size_t size = Block::SIZE,
+                             BlockSource source = BlockSource::Heap):
+        begin_(BlockMemory::allocate(size, source)), size_(size), offset_(0), padding_(0),
+        prev_(previous), source_(source) {}
+
+    ~ConcurrentBlock()
+    {
+        BlockMemory::free(begin_, size_, source_);
+        if (prev_ != nullptr)
+            delete prev_;
+    }
+
+    template<typename T>
+    T* allocAligned(size_t n, size_t alignment = alignof(T))
+    {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(begin_);
+        size_t offset = offset_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            size_t aligned = ((begin + offset + alignment - 1) & ~(alignment - 1)) - begin;
+            if (aligned + n * sizeof(T) > size_)
+                return nullptr;
+            if (offset_.compare_exchange_weak(offset, aligned + n * sizeof(T), std::memory_order_relaxed))
+            {
+                if (aligned != offset)
+                    padding_.fetch_add(aligned - offset, std::memory_order_relaxed);
+                return reinterpret_cast<T*>(begin_ + aligned);
+            }
+        }
+    }
+
+    // Exact only while no thread is allocating from the block.
+    ArenaStats stats(bool current) const
+    {
+        size_t used = offset_.load(std::memory_order_relaxed);
+        size_t padding = padding_.load(std::memory_order_relaxed);
+        return ArenaStats{used - padding, size_, 1, current ? 0 : size_ - used, padding};
+    }
+
+    const ConcurrentBlock* previous() const
+    {
+        return prev_;
     }
 private:
-    size_t cnt_;
-    Block *curr_;
+    char *begin_;
+    size_t size_;
+    std::atomic<size_t> offset_;
+    std::atomic<size_t> padding_;
+    ConcurrentBlock *prev_;
+    BlockSource source_;
+};
+
+// Arena shared by all threads: the bump pointer is advanced with a CAS, and
+// only switching to a new block takes the mutex.
+class SharedMemoryBlocks : public ReferenceCounter
+{
+public:
+    explicit SharedMemoryBlocks(BlockSource source = BlockSource::Heap) : curr_(nullptr), source_(source) {}
 
-    void addBlock()
+    ~SharedMemoryBlocks()
     {
-        curr_ = new Block(curr_);
+        ConcurrentBlock *curr = curr_.load(std::memory_order_acquire);
+        if (curr != nullptr)
+            delete curr;
     }
+
+    template<typename T>
+    T* allocMemory(size_t n)
+    {
+        ConcurrentBlock *curr = curr_.load(std::memory_order_acquire);
+        if (curr != nullptr)
+        {
+            T *result = curr->allocAligned<T>(n);
+            if (result != nullptr)
+                return result;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        ConcurrentBlock *latest = curr_.load(std::memory_order_relaxed);
+        if (latest != curr)
+        {
+            T *result = latest->allocAligned<T>(n);
+            if (result != nullptr)
+                return result;
+        }
+        size_t size = BlockMemory::roundSize(std::max(Block::SIZE, n * sizeof(T) + alignof(T)), source_);
+        ConcurrentBlock *fresh = new ConcurrentBlock(latest, size, source_);
+        T *result = fresh->allocAligned<T>(n);
+        curr_.store(fresh, std::memory_order_release);
+        return result;
+    }
+
+    // Counters are kept per block and summed here, so that allocation does not
+    // touch any more shared cache lines than the bump pointer itself.
+    ArenaStats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ArenaStats result = ArenaStats();
+        const ConcurrentBlock *curr = curr_.load(std::memory_order_acquire);
+        for (const ConcurrentBlock *block = curr; block != nullptr; block = block->previous())
+            result += block->stats(block == curr);
+        return result;
+    }
+private:
+    std::atomic<ConcurrentBlock*> curr_;
+    std::mutex mutex_;
+    BlockSource source_;
 };
 
-template<typename T>
+// Every thread allocates from its own MemoryBlocks, found through a one-entry
+// thread_local cache, so the fast path takes no lock. The per-thread arenas
+// are released together with the allocator, whichever thread drops it last.
+class ThreadLocalMemoryBlocks : public ReferenceCounter
+{
+public:
+    explicit ThreadLocalMemoryBlocks(BlockSource source = BlockSource::Heap):
+        id_(nextId()), source_(source), arenas_(nullptr) {}
+
+    ~ThreadLocalMemoryBlocks()
+    {
+        while (arenas_ != nullptr)
+        {
+            ThreadArena *next = arenas_->next;
+            delete arenas_;
+            arenas_ = next;
+        }
+    }
+
+    template<typename T>
+    T* allocMemory(size_t n)
+    {
+        return localBlocks().allocMemory<T>(n);
+    }
+
+    // Sums the per-thread counters; the threads must not be allocating.
+    ArenaStats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ArenaStats result = ArenaStats();
+        for (const ThreadArena *arena = arenas_; arena != nullptr; arena = arena->next)
+            result += arena->blocks.stats();
+        return result;
+    }
+private:
+    struct ThreadArena
+    {
+        ThreadArena(BlockSource source, std::thread::id owner, ThreadArena *next):
+            blocks(source), owner(owner), next(next) {}
+
+        MemoryBlocks blocks;
+        std::thread::id owner;
+        ThreadArena *next;
+    };
+
+    const size_t id_;
+    const BlockSource source_;
+    std::mutex mutex_;
+    ThreadArena *arenas_;
+
+    struct Cache
+    {
+        size_t id;
+        MemoryBlocks *blocks;
+    };
+
+    // Function-local so that the header stays free of out-of-line definitions.
+    static Cache& cache()
+    {
+        static thread_local Cache cached = {0, nullptr};
+        return cached;
+    }
+
+    MemoryBlocks& localBlocks()
+    {
+        Cache &cached = cache();
+        if (cached.id != id_)
+        {
+            std::thread::id owner = std::this_thread::get_id();
+            std::lock_guard<std::mutex> lock(mutex_);
+            ThreadArena *arena = arenas_;
+            while (arena != nullptr && arena->owner != owner)
+                arena = arena->next;
+            if (arena == nullptr)
+            {
+                arena = new ThreadArena(source_, owner, arenas_);
+                arenas_ = arena;
+            }
+            cached.id = id_;
+            cached.blocks = &arena->blocks;
+        }
+        return *cached.blocks;
+    }
+
+    // Identifiers are never reused, unlike addresses, so a stale cache entry
+    // can not be mistaken for a newer arena.
+    static size_t nextId()
+    {
+        static std::atomic<size_t> last_id(0);
+        return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+};
+
+template<typename T, typename Arena = MemoryBlocks>
 class StackAllocator
 {
 public:
-    template<typename U>
+    template<typename U, typename OtherArena>
     friend class StackAllocator;
+    friend class ArenaScope;
 
     using value_type = T;
     using pointer = T*;
@@ -102,42 +487,114 @@ public:
 
     StackAllocator()
     {
-        mb_ = new MemoryBlocks();
+        mb_ = new Arena();
         mb_->addReference();
     }
 
-    template<typename U>
-    StackAllocator(const StackAllocator<U> &other) : mb_(other.mb_)
+    explicit StackAllocator(BlockSource source)
+    {
+        mb_ = new Arena(source);
+        mb_->addReference();
+    }
+
+    StackAllocator(const StackAllocator &other) : mb_(other.mb_)
     {
         mb_->addReference();
     }
 
     template<typename U>
-    StackAllocator<T>& operator=(const StackAllocator &other)
+    StackAllocator(const StackAllocator<U, Arena> &other) : mb_(other.mb_)
     {
-        mb_ = other.mb_;
         mb_->addReference();
     }
 
+    StackAllocator& operator=(const StackAllocator &other)
+    {
+        other.mb_->addReference();
+        release();
+        mb_ = other.mb_;
+        return *this;
+    }
+
     ~StackAllocator()
     {
-        mb_->eraseReference();
-        if (mb_->needDestruct())
-            delete mb_;
+        release();
     }
 
     template<typename U>
     struct rebind
     {
-        using other = StackAllocator<U>;
+        using other = StackAllocator<U, Arena>;
     };
 
     pointer allocate(size_t n)
     {
-        return mb_->allocMemory<T>(n);
+        return mb_->template allocMemory<T>(n);
     }
 
     void deallocate(pointer ptr, size_t n) {}
+
+    // Equal allocators share the arena, so either can free what the other gave.
+    template<typename U>
+    bool operator==(const StackAllocator<U, Arena> &other) const
+    {
+        return mb_ == other.mb_;
+    }
+
+    template<typename U>
+    bool operator!=(const StackAllocator<U, Arena> &other) const
+    {
+        return mb_ != other.mb_;
+    }
+
+    ArenaStats stats() const
+    {
+        return mb_->stats();
+    }
+
+    template<typename A = Arena>
+    typename A::Marker mark() const
+    {
+        return mb_->mark();
+    }
+
+    template<typename A = Arena>
+    void rewind(const typename A::Marker &marker)
+    {
+        mb_->rewind(marker);
+    }
+private:
+    Arena *mb_;
+
+    void release()
+    {
+        if (mb_->eraseReference())
+            delete mb_;
+    }
+};
+
+// Everything allocated from the arena during the lifetime of the scope is
+// released at once when it ends. Containers using the arena must die first.
+class ArenaScope
+{
+public:
+    template<typename T>
+    explicit ArenaScope(const StackAllocator<T> &alloc) : mb_(alloc.mb_), marker_(mb_->mark())
+    {
+        mb_->addReference();
+    }
+
+    ArenaScope(const ArenaScope &other) = delete;
+
+    ArenaScope& operator=(const ArenaScope &other) = delete;
+
+    ~ArenaScope()
+    {
+        mb_->rewind(marker_);
+        if (mb_->eraseReference())
+            delete mb_;
+    }
 private:
     MemoryBlocks *mb_;
+    MemoryBlocks::Marker marker_;
 };
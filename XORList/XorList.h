@@ -1,6 +1,10 @@
+# pragma once
 # include <memory>
+# include <cassert>
 # include <iostream>
 # include <iterator>
+# include <functional>
+# include <type_traits>
 
 template<typename T, typename Allocator = std::allocator<T> >
 class XorList
@@ -80,62 +84,74 @@ public:
         }
     };
     typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef T value_type;
+    typedef Allocator allocator_type;
 
     explicit XorList(const Allocator &alloc = Allocator()):
-        alloc_(alloc), first_(nullptr), last_(nullptr), size_(0) {}
+        alloc_(alloc), first_(nullptr), last_(nullptr), size_(0), pool_(nullptr) {}
 
     XorList(size_t count, const T &value = T(), const Allocator &alloc = Allocator()) 
     : XorList(alloc)
     {
+        reserve(count);
         for (size_t i = 0; i < count; i++)
             push_back(value);
     }
 
-    XorList(const XorList &other) : XorList(other.alloc_)
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    XorList(InputIt first, InputIt last, const Allocator &alloc = Allocator())
+    : XorList(alloc)
     {
-        for (iterator it = other.begin(); it != other.end(); ++it)
-            push_back(*it);
+        reserveFor(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+        for (; first != last; ++first)
+            push_back(*first);
     }
 
+    XorList(const XorList &other) : XorList(other.begin(), other.end(), other.alloc_) {}
+
     XorList(XorList&& other) noexcept 
-    : alloc_(other.alloc_), first_(nullptr), last_(nullptr), size_(other.size_)
+    : alloc_(other.alloc_), first_(nullptr), last_(nullptr), size_(other.size_), pool_(nullptr)
     {
         other.size_ = 0;
         std::swap(first_, other.first_);
         std::swap(last_, other.last_);
+        std::swap(pool_, other.pool_);
     }
 
     XorList(std::initializer_list<T> init_lst, const Allocator &alloc = Allocator())
-    : XorList(alloc)
-    {
-        for (auto it = init_lst.begin(); it != init_lst.end(); ++it)
-            push_back(*it);
-    }
+    : XorList(init_lst.begin(), init_lst.end(), alloc) {}
 
     ~XorList()
     {
-        while (!empty())
-            pop_front();
+        clear();
+        if (pool_ != nullptr)
+            releasePool(pool_);
     }
 
     XorList& operator=(const XorList &other)
     {
+        if (this == &other)
+            return *this;
+        clear();
+        reserve(other.size());
         for (iterator it = other.begin(); it != other.end(); ++it)
-        {
             push_back(*it);
-        }
         return *this;
     }
 
     XorList& operator=(XorList&& other) noexcept
     {
-        size_ = other.size_;
-        other.size_ = 0;
-        alloc_ = other.alloc_;
+        std::swap(alloc_, other.alloc_);
         std::swap(first_, other.first_);
         std::swap(last_, other.last_);
-        other.first_ = nullptr;
-        other.last_ = nullptr;
+        std::swap(size_, other.size_);
+        std::swap(pool_, other.pool_);
+        return *this;
+    }
+
+    allocator_type get_allocator() const
+    {
+        return allocator_type(alloc_);
     }
 
     size_t size() const
@@ -143,6 +159,53 @@ public:
         return size_;
     }
 
+    size_t capacity() const
+    {
+        if (pool_ == nullptr)
+            return size_;
+        return size_ + findRoot(pool_)->spare_size;
+    }
+
+    // Grabs the missing nodes with a single allocate() call, so that nodes
+    // pushed afterwards lie in memory in the order they are linked.
+    void reserve(size_t count)
+    {
+        size_t cap = capacity();
+        if (count <= cap)
+            return;
+        count -= cap;
+        NodePool *pool = acquirePool();
+        Node *nodes = std::allocator_traits<NodeAllocType>::allocate(alloc_, count);
+        BatchAllocType batch_alloc(alloc_);
+        Batch *batch = std::allocator_traits<BatchAllocType>::allocate(batch_alloc, 1);
+        pool->batches = new(batch) Batch{nodes, count, pool->batches};
+        if (pool->batches_tail == nullptr)
+            pool->batches_tail = batch;
+        for (size_t i = count; i > 0; --i)
+            pushSpare(pool, nodes + i - 1);
+    }
+
+    void clear()
+    {
+        while (!empty())
+            pop_front();
+    }
+
+    // Moves the elements into one fresh batch of alloc in list order and
+    // releases the old nodes. A StackAllocator gives back its old blocks once
+    // no other container shares its arena.
+    void compact(const Allocator &alloc = Allocator())
+    {
+        XorList compacted(alloc);
+        compacted.reserve(size_);
+        while (!empty())
+        {
+            compacted.push_back(std::move(*begin()));
+            pop_front();
+        }
+        *this = std::move(compacted);
+    }
+
     bool empty() const
     {
         return size() == 0;
@@ -171,10 +234,10 @@ public:
     }
 
     template<typename U>
-    void insert_before(const iterator &it, U&& value)
+    iterator insert_before(const iterator &it, U&& value)
     {
+        Node *new_node = createNode(std::forward<U>(value));
         ++size_;
-        Node *new_node = new(std::allocator_traits<NodeAllocType>::allocate(alloc_, 1)) Node(std::forward<U>(value));
         Node *left = it.prev_, *right = it.curr_;
         Node::makeLink(left, right);
         Node::makeLink(left, new_node);
@@ -183,9 +246,10 @@ public:
             first_ = new_node;
         if (it.curr_ == nullptr)
             last_ = new_node;
+        return iterator(left, new_node);
     }
 
-    void erase(iterator it)
+    iterator erase(iterator it)
     {
         --size_;
         if (it.prev_ == nullptr)
@@ -196,14 +260,129 @@ public:
         Node::makeLink(left, curr);
         Node::makeLink(curr, right);
         Node::makeLink(left, right);
-        curr->~Node();
-        std::allocator_traits<NodeAllocType>::deallocate(alloc_, curr, 1);
+        destroyNode(curr);
+        return iterator(left, right);
+    }
 
+    iterator insert_after(iterator it, const T &value)
+    {
+        return insert_before(++it, value);
     }
 
-    void insert_after(iterator it, const T &value)
+    // Lists with unequal allocators can not take each other's nodes, as
+    // std::list requires: the elements are moved into new nodes instead.
+    void splice(const iterator &pos, XorList &other)
     {
-        insert_before(++it, value);
+        if (this == &other || other.empty())
+            return;
+        if (alloc_ != other.alloc_)
+        {
+            moveRange(pos, other, other.begin(), other.size_);
+            return;
+        }
+        sharePool(other);
+        linkChain(pos, Chain{other.first_, other.last_});
+        size_ += other.size_;
+        other.first_ = nullptr;
+        other.last_ = nullptr;
+        other.size_ = 0;
+    }
+
+    void splice(const iterator &pos, XorList &other, const iterator &it)
+    {
+        if (this == &other && pos == it)
+            return;
+        iterator last = it;
+        splice(pos, other, it, ++last);
+    }
+
+    void splice(const iterator &pos, XorList &other, const iterator &first, const iterator &last)
+    {
+        if (first == last || (this == &other && pos == last))
+            return;
+        if (this != &other)
+        {
+            size_t count = std::distance(first, last);
+            if (alloc_ != other.alloc_)
+            {
+                moveRange(pos, other, first, count);
+                return;
+            }
+            sharePool(other);
+            other.size_ -= count;
+            size_ += count;
+        }
+        linkChain(pos, other.unlinkRange(first, last));
+    }
+
+    void reverse()
+    {
+        std::swap(first_, last_);
+    }
+
+    void merge(XorList &other)
+    {
+        merge(other, std::less<T>());
+    }
+
+    template<typename Compare>
+    void merge(XorList &other, Compare comp)
+    {
+        if (this == &other || other.empty())
+            return;
+        if (alloc_ != other.alloc_)
+        {
+            XorList moved(get_allocator());
+            moved.splice(moved.end(), other);
+            merge(moved, comp);
+            return;
+        }
+        sharePool(other);
+        Chain merged = mergeChains(Chain{first_, last_}, Chain{other.first_, other.last_}, comp);
+        first_ = merged.first;
+        last_ = merged.last;
+        size_ += other.size_;
+        other.first_ = nullptr;
+        other.last_ = nullptr;
+        other.size_ = 0;
+    }
+
+    void sort()
+    {
+        sort(std::less<T>());
+    }
+
+    template<typename Compare>
+    void sort(Compare comp)
+    {
+        if (size_ < 2)
+            return;
+        // bins[i] is either empty or a sorted run of 2^i nodes taken before those in bins[i - 1].
+        Chain bins[BINS_NUM] = {};
+        size_t filled = 0;
+        Node *prev = nullptr, *curr = first_;
+        while (curr != nullptr)
+        {
+            Node *next = getPtrNum(getNumPtr(prev) ^ curr->getXor());
+            prev = curr;
+            Chain carry{nullptr, nullptr};
+            appendNode(carry, curr);
+            curr = next;
+            size_t i = 0;
+            for (; i < filled && bins[i].first != nullptr; ++i)
+            {
+                carry = mergeChains(bins[i], carry, comp);
+                bins[i] = Chain{nullptr, nullptr};
+            }
+            bins[i] = carry;
+            if (i == filled)
+                ++filled;
+        }
+        Chain sorted{nullptr, nullptr};
+        for (size_t i = 0; i < filled; ++i)
+            sorted = mergeChains(bins[i], sorted, comp);
+        first_ = sorted.first;
+        last_ = sorted.last;
     }
 
     iterator begin() const
@@ -229,6 +408,7 @@ private:
     class Node
     {
         friend class iterator;
+        friend XorList;
     public:
         Node(const T &new_value, uintptr_t new_xor = 0): 
             value_(new_value), xor_(new_xor) {}
@@ -236,6 +416,11 @@ private:
         Node(T&& new_value, uintptr_t new_xor = 0):
             value_(std::move(new_value)), xor_(new_xor) {}
 
+        bool isBatched() const
+        {
+            return (xor_ & BATCHED) != 0;
+        }
+
         Node& operator=(const Node &other) = delete;
 
         Node(const Node &other) = delete;
@@ -246,7 +431,7 @@ private:
 
         uintptr_t getXor() const
         {
-            return xor_;
+            return xor_ & ~BATCHED;
         }
 
         void updateXor(Node *new_ptr, Node *deleted_ptr = nullptr)
@@ -254,6 +439,11 @@ private:
             xor_ ^= (getNumPtr(new_ptr) ^ getNumPtr(deleted_ptr));
         }
 
+        void setLinks(Node *prev, Node *next)
+        {
+            xor_ = (xor_ & BATCHED) | (getNumPtr(prev) ^ getNumPtr(next));
+        }
+
         static void makeLink(Node *first, Node *second)
         {
             if (first == nullptr || second == nullptr)
@@ -266,10 +456,260 @@ private:
         uintptr_t xor_;
     };
 
+    struct Chain
+    {
+        Node *first, *last;
+    };
+
+    struct Batch
+    {
+        Node *nodes;
+        size_t count;
+        Batch *next;
+    };
+
+    // Storage of reserved nodes. Lists that exchange nodes through splice or
+    // merge join their pools, the joined pool forwarding to its parent. They
+    // only do so when their allocators are equal, so that whichever list
+    // releases the pool last can free batches the others allocated. The
+    // lower ranked pool joins the other, and both lists then point right at
+    // the root, so chains of parents stay short.
+    struct NodePool
+    {
+        size_t refs;
+        NodePool *parent;
+        size_t rank;
+        // The tails let pools be joined in O(1).
+        Batch *batches, *batches_tail;
+        Node *spare, *spare_tail;
+        size_t spare_size;
+    };
+
     typedef typename Allocator::template rebind<Node>::other NodeAllocType;
+    typedef typename Allocator::template rebind<Batch>::other BatchAllocType;
+    typedef typename Allocator::template rebind<NodePool>::other PoolAllocType;
     NodeAllocType alloc_;
     Node *first_, *last_;
     size_t size_;
+    NodePool *pool_;
+    static const size_t BINS_NUM = 64;
+    // Node addresses are aligned, so the lowest bit of the XOR word is free
+    // to mark nodes that live in a reserved batch.
+    static const uintptr_t BATCHED = 1;
+
+    template<typename U>
+    Node* createNode(U&& value)
+    {
+        NodePool *pool = pool_ == nullptr ? nullptr : rootPool();
+        if (pool == nullptr || pool->spare == nullptr)
+            return new(std::allocator_traits<NodeAllocType>::allocate(alloc_, 1)) Node(std::forward<U>(value));
+        Node *storage = pool->spare;
+        pool->spare = *reinterpret_cast<Node**>(storage);
+        if (pool->spare == nullptr)
+            pool->spare_tail = nullptr;
+        --pool->spare_size;
+        return new(storage) Node(std::forward<U>(value), BATCHED);
+    }
+
+    void destroyNode(Node *node)
+    {
+        bool batched = node->isBatched();
+        node->~Node();
+        if (batched)
+            pushSpare(rootPool(), node);
+        else
+            std::allocator_traits<NodeAllocType>::deallocate(alloc_, node, 1);
+    }
+
+    static void pushSpare(NodePool *pool, Node *storage)
+    {
+        new(static_cast<void*>(storage)) Node*(pool->spare);
+        if (pool->spare == nullptr)
+            pool->spare_tail = storage;
+        pool->spare = storage;
+        ++pool->spare_size;
+    }
+
+    static NodePool* findRoot(NodePool *pool)
+    {
+        while (pool->parent != nullptr)
+            pool = pool->parent;
+        return pool;
+    }
+
+    // The root of the pool of the list, with pool_ moved right onto it.
+    NodePool* rootPool()
+    {
+        NodePool *root = findRoot(pool_);
+        if (root != pool_)
+        {
+            ++root->refs;
+            releasePool(pool_);
+            pool_ = root;
+        }
+        return root;
+    }
+
+    NodePool* acquirePool()
+    {
+        if (pool_ == nullptr)
+        {
+            PoolAllocType pool_alloc(alloc_);
+            pool_ = std::allocator_traits<PoolAllocType>::allocate(pool_alloc, 1);
+            new(pool_) NodePool{1, nullptr, 0, nullptr, nullptr, nullptr, nullptr, 0};
+        }
+        return rootPool();
+    }
+
+    void sharePool(XorList &other)
+    {
+        assert(alloc_ == other.alloc_);
+        if (other.pool_ == nullptr)
+            return;
+        NodePool *other_root = other.rootPool();
+        if (pool_ == nullptr)
+        {
+            pool_ = other_root;
+            ++pool_->refs;
+            return;
+        }
+        NodePool *root = rootPool();
+        if (root == other_root)
+            return;
+        if (root->rank < other_root->rank)
+            std::swap(root, other_root);
+        else if (root->rank == other_root->rank)
+            ++root->rank;
+        if (other_root->batches != nullptr)
+        {
+            other_root->batches_tail->next = root->batches;
+            if (root->batches == nullptr)
+                root->batches_tail = other_root->batches_tail;
+            root->batches = other_root->batches;
+        }
+        if (other_root->spare != nullptr)
+        {
+            *reinterpret_cast<Node**>(other_root->spare_tail) = root->spare;
+            if (root->spare == nullptr)
+                root->spare_tail = other_root->spare_tail;
+            root->spare = other_root->spare;
+        }
+        root->spare_size += other_root->spare_size;
+        other_root->batches = other_root->batches_tail = nullptr;
+        other_root->spare = other_root->spare_tail = nullptr;
+        other_root->spare_size = 0;
+        other_root->parent = root;
+        ++root->refs;
+        rootPool();
+        other.rootPool();
+    }
+
+    void releasePool(NodePool *pool)
+    {
+        while (pool != nullptr && --pool->refs == 0)
+        {
+            NodePool *parent = pool->parent;
+            BatchAllocType batch_alloc(alloc_);
+            while (pool->batches != nullptr)
+            {
+                Batch *batch = pool->batches;
+                pool->batches = batch->next;
+                std::allocator_traits<NodeAllocType>::deallocate(alloc_, batch->nodes, batch->count);
+                std::allocator_traits<BatchAllocType>::deallocate(batch_alloc, batch, 1);
+            }
+            PoolAllocType pool_alloc(alloc_);
+            std::allocator_traits<PoolAllocType>::deallocate(pool_alloc, pool, 1);
+            pool = parent;
+        }
+    }
+
+    template<typename InputIt>
+    void reserveFor(InputIt, InputIt, std::input_iterator_tag) {}
+
+    template<typename ForwardIt>
+    void reserveFor(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
+    {
+        reserve(std::distance(first, last));
+    }
+
+    void linkChain(const iterator &pos, const Chain &chain)
+    {
+        Node *left = pos.prev_, *right = pos.curr_;
+        Node::makeLink(left, right);
+        Node::makeLink(left, chain.first);
+        Node::makeLink(chain.last, right);
+        if (left == nullptr)
+            first_ = chain.first;
+        if (right == nullptr)
+            last_ = chain.last;
+    }
+
+    // Moves count elements of other from first on into new nodes before pos.
+    void moveRange(const iterator &pos, XorList &other, iterator first, size_t count)
+    {
+        iterator at = pos;
+        for (size_t i = 0; i < count; ++i)
+        {
+            at = insert_before(at, std::move(*first));
+            ++at;
+            first = other.erase(first);
+        }
+    }
+
+    Chain unlinkRange(const iterator &first, const iterator &last)
+    {
+        Node *left = first.prev_, *right = last.curr_;
+        Chain range{first.curr_, last.prev_};
+        Node::makeLink(left, range.first);
+        Node::makeLink(range.last, right);
+        Node::makeLink(left, right);
+        if (left == nullptr)
+            first_ = right;
+        if (right == nullptr)
+            last_ = left;
+        return range;
+    }
+
+    static void appendNode(Chain &chain, Node *node)
+    {
+        node->setLinks(chain.last, nullptr);
+        if (chain.last == nullptr)
+            chain.first = node;
+        else
+            chain.last->updateXor(node);
+        chain.last = node;
+    }
+
+    template<typename Compare>
+    static Chain mergeChains(const Chain &left, const Chain &right, Compare comp)
+    {
+        if (left.first == nullptr)
+            return right;
+        if (right.first == nullptr)
+            return left;
+        Chain merged{nullptr, nullptr};
+        Node *left_prev = nullptr, *left_curr = left.first;
+        Node *right_prev = nullptr, *right_curr = right.first;
+        while (left_curr != nullptr && right_curr != nullptr)
+        {
+            bool take_right = comp(right_curr->value_, left_curr->value_);
+            Node *&prev = take_right ? right_prev : left_prev;
+            Node *&curr = take_right ? right_curr : left_curr;
+            Node *next = getPtrNum(getNumPtr(prev) ^ curr->getXor());
+            prev = curr;
+            appendNode(merged, curr);
+            curr = next;
+        }
+        Node *rest_prev = left_curr != nullptr ? left_prev : right_prev;
+        Node *rest_curr = left_curr != nullptr ? left_curr : right_curr;
+        if (rest_curr != nullptr)
+        {
+            rest_curr->updateXor(merged.last, rest_prev);
+            merged.last->updateXor(rest_curr);
+            merged.last = left_curr != nullptr ? left.last : right.last;
+        }
+        return merged;
+    }
 
     static uintptr_t getNumPtr(Node *ptr)
     {
@@ -282,4 +722,31 @@ private:
     {
         return reinterpret_cast<Node*>(addr);
     }
-};
\ No newline at end of file
+};
+
+// Traverses lst with a second iterator running distance nodes ahead. The runner
+// only chases links and prefetches the node it is about to step on, so its
+// cache misses overlap with the calls of f on the nodes behind it. Each link
+// still has to be loaded before the next address is known: the chase itself
+// stays serial, only f's work is taken off the critical path.
+template<typename T, typename Allocator, typename Function>
+Function for_each_prefetch(const XorList<T, Allocator> &lst, Function f, size_t distance = 8)
+{
+    typename XorList<T, Allocator>::iterator it = lst.begin(), ahead = lst.begin(), end = lst.end();
+    for (size_t i = 0; i < distance && ahead != end; ++i)
+    {
+        ++ahead;
+        if (ahead != end)
+            __builtin_prefetch(&*ahead);
+    }
+    for (; ahead != end; ++it)
+    {
+        f(*it);
+        ++ahead;
+        if (ahead != end)
+            __builtin_prefetch(&*ahead);
+    }
+    for (; it != end; ++it)
+        f(*it);
+    return f;
+}
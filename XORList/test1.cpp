@@ -1,9 +1,15 @@
 #include "XorList.h"
+#include "StackAllocator.h"
+#include "IntrusiveXorList.h"
+#include "IndexedXorList.h"
+#include "LruCache.h"
 #include <gtest/gtest.h>
 #include <iterator>
 #include <list>
 # include <algorithm>
 #include <random>
+#include <numeric>
+#include <thread>
 
 TEST(XorListTest, DefaultConstructor)
 {
@@ -119,6 +125,480 @@ TEST(XorListTest, Operations)
   ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), mlist2.begin()));
 }
 
+struct IntrusiveItem
+{
+    int value;
+    XorHook hook;
+
+    explicit IntrusiveItem(int new_value = 0) : value(new_value) {}
+};
+
+typedef IntrusiveXorList<IntrusiveItem, &IntrusiveItem::hook> IntrusiveList;
+
+TEST(IntrusiveXorListTest, PushAndPop)
+{
+    std::vector<IntrusiveItem> pool;
+    for (int i = 0; i < 10; ++i)
+        pool.emplace_back(i);
+    IntrusiveList mlist;
+    std::list<int> expected;
+    for (int i = 0; i < 10; ++i)
+    {
+        if (i % 2)
+        {
+            mlist.push_back(pool[i]);
+            expected.push_back(i);
+        }
+        else
+        {
+            mlist.push_front(pool[i]);
+            expected.push_front(i);
+        }
+    }
+    mlist.pop_back();
+    expected.pop_back();
+    mlist.pop_front();
+    expected.pop_front();
+    ASSERT_EQ(mlist.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist.begin(), mlist.end(), expected.begin(),
+        [](const IntrusiveItem &item, int value) { return item.value == value; }));
+    ASSERT_TRUE(std::equal(mlist.rbegin(), mlist.rend(), expected.rbegin(),
+        [](const IntrusiveItem &item, int value) { return item.value == value; }));
+}
+
+TEST(IntrusiveXorListTest, InsertAndErase)
+{
+    std::vector<IntrusiveItem> pool;
+    for (int i = 0; i < 5; ++i)
+        pool.emplace_back(i);
+    IntrusiveList mlist;
+    mlist.push_back(pool[0]);
+    mlist.push_back(pool[4]);
+    auto it = mlist.insert_before(++mlist.begin(), pool[2]);
+    mlist.insert_before(it, pool[1]);
+    it = mlist.begin();
+    ++it;
+    ++it;
+    ASSERT_EQ(it->value, 2);
+    it = mlist.erase(it);
+    ASSERT_EQ(it->value, 4);
+    mlist.erase(it);
+    mlist.insert_after(--mlist.end(), pool[3]);
+    mlist.push_back(pool[2]);
+    std::vector<int> expected{0, 1, 3, 2};
+    ASSERT_TRUE(std::equal(mlist.begin(), mlist.end(), expected.begin(),
+        [](const IntrusiveItem &item, int value) { return item.value == value; }));
+}
+
+TEST(XorListTest, Reverse)
+{
+    XorList<int> mlist1{1, 2, 3, 4, 5};
+    std::list<int> mlist2{5, 4, 3, 2, 1};
+    mlist1.reverse();
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), mlist2.begin()));
+    mlist1.push_back(0);
+    mlist1.push_front(6);
+    mlist2.push_back(0);
+    mlist2.push_front(6);
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), mlist2.rbegin()));
+}
+
+TEST(XorListTest, Splice)
+{
+    XorList<int> mlist1{1, 2, 3};
+    XorList<int> mlist2{4, 5, 6, 7};
+    mlist1.splice(++mlist1.begin(), mlist2);
+    ASSERT_TRUE(mlist2.empty());
+    std::vector<int> expected{1, 4, 5, 6, 7, 2, 3};
+    ASSERT_EQ(mlist1.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), expected.begin()));
+
+    auto first = mlist1.begin(), last = mlist1.begin();
+    std::advance(first, 1);
+    std::advance(last, 4);
+    mlist2.splice(mlist2.end(), mlist1, first, last);
+    expected = {1, 7, 2, 3};
+    ASSERT_EQ(mlist1.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), expected.begin()));
+    expected = {4, 5, 6};
+    ASSERT_EQ(mlist2.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist2.begin(), mlist2.end(), expected.begin()));
+
+    mlist1.splice(mlist1.begin(), mlist1, --mlist1.end());
+    mlist1.splice(mlist1.end(), mlist1, ++mlist1.begin(), --mlist1.end());
+    expected = {3, 2, 1, 7};
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), expected.begin()));
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), expected.rbegin()));
+}
+
+TEST(XorListTest, SpliceAcrossArenas)
+{
+    typedef XorList<int, StackAllocator<int> > List;
+    List mlist1{1, 2, 3}, mlist2;
+    {
+        List source{4, 5, 6}, other{7, 8, 9};
+        ASSERT_TRUE(source.get_allocator() != mlist1.get_allocator());
+        mlist1.splice(mlist1.end(), source);
+        ASSERT_TRUE(source.empty());
+        mlist1.splice(mlist1.begin(), other, ++other.begin(), other.end());
+        mlist1.splice(mlist1.end(), other, other.begin());
+        ASSERT_TRUE(other.empty());
+        List odd{1, 3, 5}, even{2, 4, 6};
+        odd.merge(even);
+        ASSERT_TRUE(even.empty());
+        mlist2 = std::move(odd);
+    }
+    std::vector<int> expected{8, 9, 1, 2, 3, 4, 5, 6, 7};
+    ASSERT_EQ(mlist1.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), expected.begin()));
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), expected.rbegin()));
+    expected = {1, 2, 3, 4, 5, 6};
+    ASSERT_EQ(mlist2.size(), expected.size());
+    ASSERT_TRUE(std::equal(mlist2.begin(), mlist2.end(), expected.begin()));
+}
+
+TEST(XorListTest, MergeAndSort)
+{
+    std::random_device rd;
+    std::default_random_engine gen(rd());
+    std::uniform_int_distribution<int> num_distr(0, 100);
+    XorList<std::pair<int, int> > mlist1, mlist3;
+    std::list<std::pair<int, int> > mlist2, mlist4;
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::pair<int, int> cur(num_distr(gen), i);
+        mlist1.push_back(cur);
+        mlist2.push_back(cur);
+    }
+    auto by_first = [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+    {
+        return a.first < b.first;
+    };
+    mlist1.sort(by_first);
+    mlist2.sort(by_first);
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), mlist2.begin()));
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), mlist2.rbegin()));
+    for (int i = 0; i < 5000; ++i)
+    {
+        std::pair<int, int> cur(num_distr(gen), -i);
+        mlist3.push_back(cur);
+        mlist4.push_back(cur);
+    }
+    mlist3.sort(by_first);
+    mlist4.sort(by_first);
+    mlist1.merge(mlist3, by_first);
+    mlist2.merge(mlist4, by_first);
+    ASSERT_TRUE(mlist3.empty());
+    ASSERT_EQ(mlist1.size(), mlist2.size());
+    ASSERT_TRUE(std::equal(mlist1.begin(), mlist1.end(), mlist2.begin()));
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), mlist2.rbegin()));
+}
+
+template<typename Allocator>
+void checkReservedOrder()
+{
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    XorList<int, Allocator> mlist(values.begin(), values.end());
+    ASSERT_EQ(mlist.size(), values.size());
+    ASSERT_TRUE(std::equal(mlist.begin(), mlist.end(), values.begin()));
+    auto prev = mlist.begin();
+    for (auto it = std::next(prev); it != mlist.end(); prev = it++)
+        ASSERT_GT(&*it, &*prev);
+}
+
+TEST(XorListTest, RangeConstructorOrder)
+{
+    checkReservedOrder<std::allocator<int> >();
+    checkReservedOrder<StackAllocator<int> >();
+}
+
+TEST(XorListTest, Reserve)
+{
+    XorList<int> mlist;
+    mlist.reserve(100);
+    ASSERT_EQ(mlist.capacity(), 100);
+    for (int i = 0; i < 150; ++i)
+        mlist.push_back(i);
+    ASSERT_EQ(mlist.capacity(), 150);
+    for (int i = 0; i < 100; ++i)
+        mlist.pop_front();
+    ASSERT_EQ(mlist.capacity(), 150);
+    for (int i = 0; i < 60; ++i)
+        mlist.push_front(i);
+    ASSERT_EQ(mlist.capacity(), 150);
+    XorList<int> mlist2(5, 7);
+    ASSERT_EQ(mlist2.capacity(), 5);
+    XorList<int> mlist3(mlist);
+    mlist3.splice(mlist3.begin(), mlist2);
+    mlist2 = mlist3;
+    mlist2.splice(mlist2.end(), mlist, mlist.begin(), std::next(mlist.begin(), 10));
+    mlist.clear();
+    mlist.push_back(1);
+    ASSERT_EQ(mlist3.size() + 10, mlist2.size());
+    ASSERT_EQ(*mlist2.begin(), 7);
+    ASSERT_EQ(*mlist2.rbegin(), 50);
+}
+
+TEST(XorListTest, SpliceChainOfPools)
+{
+    std::vector<XorList<int> > lists(20);
+    for (size_t i = 0; i < lists.size(); ++i)
+    {
+        lists[i].reserve(10);
+        lists[i].push_back(i);
+    }
+    // A into B, B into C, ...: every list ends up sharing one pool.
+    for (size_t i = 0; i + 1 < lists.size(); ++i)
+    {
+        lists[i + 1].splice(lists[i + 1].begin(), lists[i]);
+        lists[i].push_back(-1);
+        lists[i].pop_back();
+    }
+    XorList<int> &all = lists.back();
+    ASSERT_EQ(all.size(), 20);
+    ASSERT_EQ(all.capacity(), 200);
+    int expected = 0;
+    for (int value : all)
+        ASSERT_EQ(value, expected++);
+    for (size_t i = 0; i + 1 < lists.size(); ++i)
+        lists[i].push_back(i);
+    ASSERT_EQ(all.capacity(), 200 - 19);
+    all.clear();
+    ASSERT_EQ(all.capacity(), 200 - 19);
+}
+
+TEST(XorListTest, Compact)
+{
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    std::shuffle(values.begin(), values.end(), std::default_random_engine(42));
+    XorList<int, StackAllocator<int> > mlist;
+    for (int value : values)
+    {
+        mlist.push_back(value);
+        mlist.push_front(-value);
+        mlist.pop_front();
+    }
+    mlist.sort();
+    mlist.compact();
+    ASSERT_EQ(mlist.size(), values.size());
+    int expected = 0;
+    const char *first = reinterpret_cast<const char*>(&*mlist.begin());
+    const char *second = reinterpret_cast<const char*>(&*std::next(mlist.begin()));
+    for (auto it = mlist.begin(); it != mlist.end(); ++it, ++expected)
+    {
+        ASSERT_EQ(*it, expected);
+        ASSERT_EQ(reinterpret_cast<const char*>(&*it), first + expected * (second - first));
+    }
+    mlist.push_back(1000);
+    ASSERT_EQ(*mlist.rbegin(), 1000);
+}
+
+void checkIndexedOperations(size_t step)
+{
+    std::default_random_engine gen(step);
+    std::uniform_int_distribution<int> op_distr(0, 5);
+    IndexedXorList<int> mlist1(step);
+    std::vector<int> mlist2;
+    for (int i = 0; i < 20000; ++i)
+    {
+        int op = op_distr(gen);
+        if (op <= 2 || mlist2.empty())
+        {
+            size_t pos = std::uniform_int_distribution<size_t>(0, mlist2.size())(gen);
+            if (op == 0)
+                pos = mlist2.size();
+            mlist1.insert(pos, i);
+            mlist2.insert(mlist2.begin() + pos, i);
+        }
+        else if (op <= 4)
+        {
+            size_t pos = std::uniform_int_distribution<size_t>(0, mlist2.size() - 1)(gen);
+            mlist1.erase(pos);
+            mlist2.erase(mlist2.begin() + pos);
+        }
+        else
+        {
+            size_t pos = std::uniform_int_distribution<size_t>(0, mlist2.size() - 1)(gen);
+            ASSERT_EQ(mlist1[pos], mlist2[pos]);
+        }
+    }
+    ASSERT_EQ(mlist1.size(), mlist2.size());
+    for (size_t i = 0; i < mlist2.size(); ++i)
+        ASSERT_EQ(mlist1[i], mlist2[i]);
+    ASSERT_TRUE(std::equal(mlist1.rbegin(), mlist1.rend(), mlist2.rbegin()));
+    ASSERT_THROW(mlist1.at(mlist2.size()), std::out_of_range);
+}
+
+TEST(IndexedXorListTest, Operations)
+{
+    checkIndexedOperations(1);
+    checkIndexedOperations(3);
+    checkIndexedOperations(64);
+}
+
+TEST(IndexedXorListTest, FrontAndBack)
+{
+    IndexedXorList<int> mlist(4);
+    for (int i = 0; i < 100; ++i)
+    {
+        mlist.push_back(i);
+        mlist.push_front(-i);
+    }
+    for (int i = 0; i < 30; ++i)
+    {
+        mlist.pop_front();
+        mlist.pop_back();
+    }
+    for (int i = 0; i < 140; ++i)
+        ASSERT_EQ(mlist[i], i < 70 ? i - 69 : i - 70);
+}
+
+TEST(LruCacheTest, Eviction)
+{
+    LruCache<int, std::string> cache(3);
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    ASSERT_EQ(*cache.get(1), "one");
+    cache.put(4, "four");
+    ASSERT_FALSE(cache.contains(2));
+    cache.put(3, "drei");
+    cache.put(5, "five");
+    ASSERT_FALSE(cache.contains(1));
+    ASSERT_EQ(*cache.get(3), "drei");
+    ASSERT_EQ(*cache.get(4), "four");
+    ASSERT_EQ(cache.get(2), nullptr);
+    ASSERT_TRUE(cache.erase(5));
+    ASSERT_EQ(cache.size(), 2);
+}
+
+TEST(LruCacheTest, Operations)
+{
+    std::default_random_engine gen(1);
+    std::uniform_int_distribution<int> key_distr(0, 200);
+    std::uniform_int_distribution<int> op_distr(0, 2);
+    const size_t capacity = 64;
+    LruCache<int, int> cache(capacity);
+    std::list<std::pair<int, int> > expected;
+    for (int i = 0; i < 100000; ++i)
+    {
+        int key = key_distr(gen);
+        auto found = std::find_if(expected.begin(), expected.end(),
+            [key](const std::pair<int, int> &entry) { return entry.first == key; });
+        int op = op_distr(gen);
+        if (op == 0)
+        {
+            int *value = cache.get(key);
+            ASSERT_EQ(value == nullptr, found == expected.end());
+            if (value != nullptr)
+            {
+                ASSERT_EQ(*value, found->second);
+                expected.splice(expected.begin(), expected, found);
+            }
+        }
+        else if (op == 1)
+        {
+            cache.put(key, i);
+            if (found != expected.end())
+                expected.erase(found);
+            else if (expected.size() == capacity)
+                expected.pop_back();
+            expected.emplace_front(key, i);
+        }
+        else
+        {
+            ASSERT_EQ(cache.erase(key), found != expected.end());
+            if (found != expected.end())
+                expected.erase(found);
+        }
+        ASSERT_EQ(cache.size(), expected.size());
+    }
+}
+
+TEST(XorListTest, ForEachPrefetch)
+{
+    XorList<int> mlist;
+    for (int i = 0; i < 1000; ++i)
+        mlist.push_front(i);
+    for (size_t distance : {0, 1, 8, 999, 1000, 5000})
+    {
+        std::vector<int> visited;
+        for_each_prefetch(mlist, [&visited](int value) { visited.push_back(value); }, distance);
+        ASSERT_EQ(visited.size(), mlist.size());
+        ASSERT_TRUE(std::equal(mlist.begin(), mlist.end(), visited.begin()));
+    }
+}
+
+template<typename Arena>
+void checkConcurrentLists()
+{
+    const int THREADS_NUM = 4, N = 20000;
+    StackAllocator<int, Arena> alloc;
+    std::vector<XorList<int, StackAllocator<int, Arena> > > lists(THREADS_NUM, XorList<int, StackAllocator<int, Arena> >(alloc));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS_NUM; ++t)
+        threads.emplace_back([&lists, t]()
+        {
+            for (int i = 0; i < N; ++i)
+                lists[t].push_back(t * N + i);
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    for (int t = 0; t < THREADS_NUM; ++t)
+    {
+        ASSERT_EQ(lists[t].size(), N);
+        int expected = t * N;
+        for (int x : lists[t])
+            ASSERT_EQ(x, expected++);
+    }
+}
+
+TEST(StackAllocatorTest, Threads)
+{
+    checkConcurrentLists<SharedMemoryBlocks>();
+    checkConcurrentLists<ThreadLocalMemoryBlocks>();
+}
+
+TEST(StackAllocatorTest, Stats)
+{
+    StackAllocator<char> alloc;
+    StackAllocator<double> doubles(alloc);
+    alloc.allocate(1);
+    doubles.allocate(1);
+    ArenaStats stats = alloc.stats();
+    ASSERT_EQ(stats.requested, 1 + sizeof(double));
+    ASSERT_EQ(stats.alignment_waste, alignof(double) - 1);
+    ASSERT_EQ(stats.blocks, 1);
+    ASSERT_EQ(stats.reserved, Block::SIZE);
+    auto marker = alloc.mark();
+    alloc.allocate(Block::SIZE);
+    stats = alloc.stats();
+    ASSERT_EQ(stats.blocks, 2);
+    ASSERT_EQ(stats.tail_waste, Block::SIZE - 2 * alignof(double));
+    alloc.rewind(marker);
+    ASSERT_EQ(alloc.stats().blocks, 1);
+    ASSERT_EQ(alloc.stats().requested, 1 + sizeof(double));
+}
+
+TEST(StackAllocatorTest, BlockSources)
+{
+    for (BlockSource source : {BlockSource::Heap, BlockSource::Mmap, BlockSource::HugePages})
+    {
+        StackAllocator<int> alloc(source);
+        XorList<int, StackAllocator<int> > mlist(alloc);
+        for (int i = 0; i < 100000; ++i)
+            mlist.push_back(i);
+        int expected = 0;
+        for (int x : mlist)
+            ASSERT_EQ(x, expected++);
+        ASSERT_EQ(alloc.stats().reserved % BlockMemory::roundSize(1, source), 0);
+    }
+    StackAllocator<char> alloc(BlockSource::HugePages);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(alloc.allocate(1)) % BlockMemory::HUGE_PAGE_SIZE, 0);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -8,6 +8,12 @@
 #include <list>
 #include <random>
 #include <vector>
+void print_stats(const ArenaStats &stats) {
+    std::cout << "  requested " << stats.requested << " B, reserved "
+              << stats.reserved << " B in " << stats.blocks << " blocks, tail waste "
+              << stats.tail_waste << " B, alignment waste "
+              << stats.alignment_waste << " B\n";
+}
 template<typename _List>
 _List process_operations(size_t n1, size_t n2, const std::vector<int> &mvec) {
     _List mlist;
@@ -50,6 +56,7 @@ void process_sample(size_t n1, size_t n2, const std::string &str) {
     std::cout << "Stack allocator " + str << ":\t"
               << std::chrono::duration<double, std::milli>(end - begin).count()
               << " ms\n";
+    print_stats(l2.get_allocator().stats());
     assert(std::equal(l1.begin(), l1.end(), l2.begin()));
 }
 int main() {
@@ -0,0 +1,71 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template<typename _List>
+double scan_time(const _List &mlist, long long &sum) {
+    auto begin = std::chrono::steady_clock::now();
+    sum = 0;
+    for (auto it = mlist.begin(); it != mlist.end(); ++it)
+        sum += *it;
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// Erases and reinserts random stretches, then sorts, so that list order no
+// longer follows allocation order.
+template<typename _List>
+void fragment(_List &mlist, size_t rounds, std::mt19937 &gen) {
+    std::uniform_int_distribution<int> distr(0, 1000);
+    for (size_t r = 0; r < rounds; ++r) {
+        auto it = mlist.begin();
+        while (it != mlist.end()) {
+            if (distr(gen) % 2) {
+                it = mlist.erase(it);
+                mlist.push_back(distr(gen));
+            } else {
+                ++it;
+            }
+        }
+    }
+    mlist.sort();
+}
+
+template<typename _Allocator>
+void process_sample(size_t n, const std::string &str) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> distr(0, 1000);
+    XorList<int, _Allocator> mlist;
+    long long expected = 0;
+    for (size_t i = 0; i < n; ++i) {
+        mlist.push_back(distr(gen));
+        expected += *mlist.rbegin();
+    }
+    long long fresh_sum, fragmented_sum, compacted_sum;
+    double fresh = scan_time(mlist, fresh_sum);
+    fragment(mlist, 3, gen);
+    double fragmented = scan_time(mlist, fragmented_sum);
+    auto begin = std::chrono::steady_clock::now();
+    mlist.compact();
+    auto end = std::chrono::steady_clock::now();
+    double compacted = scan_time(mlist, compacted_sum);
+    std::cout << str << ":\tfresh " << fresh << " ms,\tfragmented "
+              << fragmented << " ms,\tcompact "
+              << std::chrono::duration<double, std::milli>(end - begin).count()
+              << " ms,\tcompacted " << compacted << " ms\n";
+    assert(fresh_sum == expected);
+    assert(fragmented_sum == compacted_sum);
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    process_sample<std::allocator<int>>(n, "Standard allocator");
+    process_sample<StackAllocator<int>>(n, "Stack allocator");
+    return 0;
+}
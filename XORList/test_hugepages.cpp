@@ -0,0 +1,61 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Huge pages actually backing anonymous memory of the process, in KiB.
+size_t anon_huge_pages() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    size_t value = 0;
+    while (smaps >> key) {
+        if (key == "AnonHugePages:") {
+            smaps >> value;
+            break;
+        }
+    }
+    return value;
+}
+
+void process_sample(size_t n, BlockSource source, const std::string &str) {
+    std::mt19937_64 gen(42);
+    XorList<unsigned long long, StackAllocator<unsigned long long>> mlist(
+        (StackAllocator<unsigned long long>(source)));
+    for (size_t i = 0; i < n; ++i)
+        mlist.push_back(gen());
+    // Sorting relinks the nodes, so that neighbours in the list are far apart
+    // in memory and nearly every step of the traversal touches a new page.
+    mlist.sort();
+    size_t huge = anon_huge_pages();
+    unsigned long long expected = 0;
+    for (auto x : mlist)
+        expected ^= x;
+    auto begin = std::chrono::steady_clock::now();
+    unsigned long long hash = 0;
+    for (int pass = 0; pass < 3; ++pass)
+        for (auto x : mlist)
+            hash ^= x;
+    auto end = std::chrono::steady_clock::now();
+    assert(hash == expected);
+    std::cout << str << ":\t"
+              << std::chrono::duration<double, std::nano>(end - begin).count() / (3 * n)
+              << " ns per node,\t" << huge / 1024 << " MiB in huge pages\n";
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    std::ifstream mode("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string thp;
+    std::getline(mode, thp);
+    std::cout << "Transparent huge pages: " << thp << "\n"
+              << n << " nodes, " << n * 16 / (1024 * 1024) << " MiB of arena\n";
+    process_sample(n, BlockSource::Heap, "Heap blocks");
+    process_sample(n, BlockSource::Mmap, "Mapped blocks");
+    process_sample(n, BlockSource::HugePages, "Huge page blocks");
+    return 0;
+}
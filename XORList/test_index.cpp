@@ -0,0 +1,69 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include "IndexedXorList.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template<typename _Access>
+double measure(const std::vector<size_t> &positions, _Access access,
+               long long &sum) {
+    auto begin = std::chrono::steady_clock::now();
+    sum = 0;
+    for (size_t pos : positions)
+        sum += access(pos);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() /
+           positions.size();
+}
+
+void process_sample(size_t n, size_t step, const std::vector<size_t> &positions,
+                    long long expected) {
+    IndexedXorList<int, StackAllocator<int>> mlist(step);
+    for (size_t i = 0; i < n; ++i)
+        mlist.push_back(i);
+    long long sum;
+    double lookup = measure(positions,
+                            [&mlist](size_t pos) { return mlist[pos]; }, sum);
+    assert(sum == expected);
+    std::mt19937 gen(7);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < positions.size(); ++i) {
+        mlist.erase(positions[i] % mlist.size());
+        mlist.insert(std::uniform_int_distribution<size_t>(0, mlist.size())(gen), i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "step " << step << ":\t" << lookup << " ns per lookup,\t"
+              << std::chrono::duration<double, std::nano>(end - begin).count() /
+                     positions.size()
+              << " ns per erase + insert\n";
+}
+
+int main() {
+    size_t n, queries;
+    std::cin >> n >> queries;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> distr(0, n - 1);
+    std::vector<size_t> positions(queries);
+    std::generate(positions.begin(), positions.end(),
+                  [&distr, &gen]() { return distr(gen); });
+    long long expected = 0;
+    for (size_t pos : positions)
+        expected += pos;
+
+    XorList<int, StackAllocator<int>> plain;
+    for (size_t i = 0; i < n; ++i)
+        plain.push_back(i);
+    long long sum;
+    double walk = measure(positions, [&plain](size_t pos) {
+        return *std::next(plain.begin(), pos);
+    }, sum);
+    assert(sum == expected);
+    std::cout << "no index:\t" << walk << " ns per lookup\n";
+    for (size_t step = 1; step <= n; step *= 4)
+        process_sample(n, step, positions, expected);
+    return 0;
+}
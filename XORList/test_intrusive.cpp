@@ -0,0 +1,72 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include "IntrusiveXorList.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct Item {
+    int value;
+    XorHook hook;
+
+    explicit Item(int new_value = 0) : value(new_value) {}
+};
+
+template<typename _List>
+long long process_operations(_List &mlist, std::vector<Item> &pool,
+                             const std::vector<int> &mvec) {
+    for (size_t i = 0; i < pool.size(); ++i) {
+        pool[i].value = mvec[i];
+        if (mvec[i] % 2)
+            mlist.push_back(pool[i]);
+        else
+            mlist.push_front(pool[i]);
+    }
+    long long sum = 0;
+    for (auto it = mlist.begin(); it != mlist.end(); ++it)
+        sum += it->value;
+    while (!mlist.empty())
+        mlist.pop_back();
+    return sum;
+}
+
+template<typename _List>
+void process_sample(std::vector<Item> &pool, const std::vector<int> &mvec,
+                    const std::string &str, long long expected) {
+    auto begin = std::chrono::steady_clock::now();
+    long long sum;
+    {
+        _List mlist;
+        sum = process_operations(mlist, pool, mvec);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << str << ":\t"
+              << std::chrono::duration<double, std::milli>(end - begin).count()
+              << " ms\n";
+    assert(sum == expected);
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<int> distr(0, 1000);
+    std::vector<int> mvec(n);
+    std::generate(mvec.begin(), mvec.end(),
+                  [&distr, &gen]() { return distr(gen); });
+    long long expected = 0;
+    for (int x : mvec)
+        expected += x;
+    std::vector<Item> pool(n);
+    process_sample<XorList<Item, std::allocator<Item>>>(
+        pool, mvec, "XorList, standard allocator", expected);
+    process_sample<XorList<Item, StackAllocator<Item>>>(
+        pool, mvec, "XorList, stack allocator", expected);
+    process_sample<IntrusiveXorList<Item, &Item::hook>>(
+        pool, mvec, "IntrusiveXorList", expected);
+    return 0;
+}
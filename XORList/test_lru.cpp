@@ -0,0 +1,102 @@
+#include "LruCache.h"
+#include <malloc.h>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Usable size plus the malloc chunk header, i.e. what an allocation really costs.
+static size_t live_bytes = 0;
+
+void* operator new(size_t count) {
+    void *ptr = std::malloc(count);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    live_bytes += malloc_usable_size(ptr) + sizeof(size_t);
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr != nullptr)
+        live_bytes -= malloc_usable_size(ptr) + sizeof(size_t);
+    std::free(ptr);
+}
+
+template<typename Key, typename Value>
+class StdLruCache {
+public:
+    explicit StdLruCache(size_t capacity)
+        : capacity_(capacity), index_(capacity) {}
+
+    Value* get(const Key &key) {
+        auto found = index_.find(key);
+        if (found == index_.end())
+            return nullptr;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return &found->second->second;
+    }
+
+    void put(const Key &key, const Value &value) {
+        auto found = index_.find(key);
+        if (found != index_.end()) {
+            found->second->second = value;
+            entries_.splice(entries_.begin(), entries_, found->second);
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+        entries_.emplace_front(key, value);
+        index_.emplace(key, entries_.begin());
+    }
+private:
+    size_t capacity_;
+    std::list<std::pair<Key, Value>> entries_;
+    std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator> index_;
+};
+
+template<typename _Cache>
+void process_sample(size_t capacity, const std::vector<int> &keys,
+                    const std::string &str) {
+    size_t before = live_bytes;
+    _Cache cache(capacity);
+    for (size_t i = 0; i < capacity; ++i)
+        cache.put(-static_cast<int>(i) - 1, 0);
+    size_t filled = live_bytes - before;
+    long long hits = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i % 2) {
+            cache.put(keys[i], i);
+        } else {
+            int *value = cache.get(keys[i]);
+            if (value != nullptr)
+                hits += 1;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << str << ":\t"
+              << static_cast<double>(filled) / capacity << " bytes per entry,\t"
+              << std::chrono::duration<double, std::nano>(end - begin).count() /
+                     keys.size()
+              << " ns per operation,\t" << hits << " hits\n";
+}
+
+int main() {
+    size_t capacity, operations;
+    std::cin >> capacity >> operations;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> distr(0, 2 * capacity);
+    std::vector<int> keys(operations);
+    for (int &key : keys)
+        key = distr(gen);
+    process_sample<StdLruCache<int, int>>(capacity, keys,
+                                          "std::list + unordered_map");
+    process_sample<LruCache<int, int>>(capacity, keys, "LruCache");
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct Work {
+    unsigned long long hash = 0;
+
+    void operator()(unsigned long long value) {
+        for (int i = 0; i < 4; ++i)
+            hash = (hash ^ value) * 0x100000001b3ULL;
+    }
+};
+
+template<typename _Traverse>
+void process_sample(const std::string &str, _Traverse traverse,
+                    unsigned long long expected, size_t n) {
+    auto begin = std::chrono::steady_clock::now();
+    unsigned long long hash = traverse();
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "  " << str << ":\t"
+              << std::chrono::duration<double, std::nano>(end - begin).count() / n
+              << " ns per node\n";
+    assert(hash == expected);
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    std::mt19937_64 gen(42);
+    XorList<unsigned long long, StackAllocator<unsigned long long>> mlist;
+    for (size_t i = 0; i < n; ++i)
+        mlist.push_back(gen());
+    for (int shuffled = 0; shuffled < 2; ++shuffled) {
+        if (shuffled)
+            mlist.sort();
+        std::cout << (shuffled ? "Scattered nodes, " : "Sequential nodes, ")
+                  << n * sizeof(unsigned long long) * 2 / 1024 << " KiB:\n";
+        Work plain;
+        for (auto it = mlist.begin(); it != mlist.end(); ++it)
+            plain(*it);
+        process_sample("plain loop", [&mlist]() {
+            Work work;
+            for (auto it = mlist.begin(); it != mlist.end(); ++it)
+                work(*it);
+            return work.hash;
+        }, plain.hash, n);
+        for (size_t distance : {1, 4, 16, 64}) {
+            process_sample("prefetch distance " + std::to_string(distance),
+                           [&mlist, distance]() {
+                return for_each_prefetch(mlist, Work(), distance).hash;
+            }, plain.hash, n);
+        }
+    }
+    return 0;
+}
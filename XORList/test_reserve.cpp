@@ -0,0 +1,104 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template<typename _List>
+long long scan(const _List &mlist) {
+    long long sum = 0;
+    for (auto it = mlist.begin(); it != mlist.end(); ++it)
+        sum += *it;
+    return sum;
+}
+
+// Two lists grown side by side, so that neighbouring nodes of one list are
+// never neighbours in memory.
+template<typename _List>
+std::vector<_List> build_interleaved(const std::vector<int> &mvec) {
+    std::vector<_List> lists(2, _List(typename _List::allocator_type()));
+    for (size_t i = 0; i < mvec.size(); ++i) {
+        lists[0].push_back(mvec[i]);
+        lists[1].push_back(mvec[i]);
+    }
+    return lists;
+}
+
+template<typename _List>
+std::vector<_List> build_bulk(const std::vector<int> &mvec) {
+    std::vector<_List> lists;
+    lists.reserve(2);
+    lists.emplace_back(mvec.begin(), mvec.end());
+    lists.emplace_back(mvec.begin(), mvec.end());
+    return lists;
+}
+
+template<typename _List>
+void process_sample(std::vector<_List> (*build)(const std::vector<int>&),
+                    const std::vector<int> &mvec, const std::string &str,
+                    long long expected) {
+    auto begin = std::chrono::steady_clock::now();
+    auto lists = build(mvec);
+    auto built = std::chrono::steady_clock::now();
+    long long sum = scan(lists[0]);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << str << ":\tbuild "
+              << std::chrono::duration<double, std::milli>(built - begin).count()
+              << " ms,\tscan "
+              << std::chrono::duration<double, std::milli>(end - built).count()
+              << " ms\n";
+    assert(sum == expected);
+}
+
+// Reserved nodes spliced out of a list must survive it, whether the two lists
+// share an arena or not.
+template<typename _Allocator>
+void check_splice_reserved(const std::vector<int> &mvec, long long expected) {
+    typedef XorList<int, _Allocator> _List;
+    _List separate, shared;
+    {
+        _List source;
+        source.reserve(mvec.size());
+        for (int x : mvec)
+            source.push_back(x);
+        separate.splice(separate.end(), source);
+        _List sibling(shared.get_allocator());
+        sibling.reserve(mvec.size());
+        for (int x : mvec)
+            sibling.push_back(x);
+        shared.splice(shared.end(), sibling);
+    }
+    assert(scan(separate) == expected);
+    assert(scan(shared) == expected);
+}
+
+template<typename _Allocator>
+void process_allocator(const std::vector<int> &mvec, const std::string &str,
+                       long long expected) {
+    typedef XorList<int, _Allocator> _List;
+    process_sample<_List>(build_interleaved<_List>, mvec,
+                          "push_back, " + str, expected);
+    process_sample<_List>(build_bulk<_List>, mvec,
+                          "range constructor, " + str, expected);
+    check_splice_reserved<_Allocator>(mvec, expected);
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<int> distr(0, 1000);
+    std::vector<int> mvec(n);
+    std::generate(mvec.begin(), mvec.end(),
+                  [&distr, &gen]() { return distr(gen); });
+    long long expected = 0;
+    for (int x : mvec)
+        expected += x;
+    process_allocator<std::allocator<int>>(mvec, "standard allocator", expected);
+    process_allocator<StackAllocator<int>>(mvec, "stack allocator", expected);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <random>
+#include <vector>
+
+// A request handler: builds a couple of temporary containers and folds them.
+template<typename _Allocator>
+long long handle_request(const std::vector<int> &payload, const _Allocator &alloc) {
+    XorList<int, _Allocator> queue(alloc);
+    std::list<int, _Allocator> log(alloc);
+    for (int x : payload) {
+        queue.push_back(x);
+        if (x % 3 == 0)
+            log.push_front(x);
+    }
+    long long sum = 0;
+    for (int x : queue)
+        sum += x;
+    for (int x : log)
+        sum -= x;
+    return sum;
+}
+
+template<typename _Handler>
+void process_sample(const std::vector<std::vector<int>> &requests,
+                    _Handler handler, const std::string &str, long long expected) {
+    auto begin = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for (const auto &payload : requests)
+        sum += handler(payload);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << str << ":\t"
+              << std::chrono::duration<double, std::micro>(end - begin).count() /
+                     requests.size()
+              << " us per request\n";
+    assert(sum == expected);
+}
+
+int main() {
+    size_t requests_num, payload_size;
+    std::cin >> requests_num >> payload_size;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> distr(0, 1000);
+    std::vector<std::vector<int>> requests(requests_num, std::vector<int>(payload_size));
+    for (auto &payload : requests)
+        for (int &x : payload)
+            x = distr(gen);
+    long long expected = 0;
+    for (const auto &payload : requests)
+        expected += handle_request(payload, std::allocator<int>());
+
+    process_sample(requests, [](const std::vector<int> &payload) {
+        return handle_request(payload, std::allocator<int>());
+    }, "Standard allocator", expected);
+    process_sample(requests, [](const std::vector<int> &payload) {
+        return handle_request(payload, StackAllocator<int>());
+    }, "Stack allocator, arena per request", expected);
+    StackAllocator<int> arena;
+    process_sample(requests, [&arena](const std::vector<int> &payload) {
+        ArenaScope scope(arena);
+        return handle_request(payload, arena);
+    }, "Stack allocator, ArenaScope per request", expected);
+    return 0;
+}
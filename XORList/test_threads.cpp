@@ -0,0 +1,53 @@
+#include "StackAllocator.h"
+#include "XorList.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void print_stats(const std::allocator<int> &alloc) {}
+
+template<typename _Allocator>
+void print_stats(const _Allocator &alloc) {
+    ArenaStats stats = alloc.stats();
+    std::cout << "    requested " << stats.requested << " B, reserved "
+              << stats.reserved << " B in " << stats.blocks << " blocks, tail waste "
+              << stats.tail_waste << " B, alignment waste "
+              << stats.alignment_waste << " B\n";
+}
+
+// Every thread builds its own list, but all of them share one allocator.
+template<typename _Allocator>
+void process_sample(size_t threads_num, size_t n, const std::string &str) {
+    _Allocator alloc;
+    std::vector<XorList<int, _Allocator>> lists(threads_num, XorList<int, _Allocator>(alloc));
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_num; ++t)
+        threads.emplace_back([&lists, t, n]() {
+            for (size_t i = 0; i < n; ++i)
+                lists[t].push_back(i);
+        });
+    for (std::thread &thread : threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+    for (const auto &mlist : lists)
+        assert(mlist.size() == n);
+    std::cout << "  " << str << ":\t"
+              << std::chrono::duration<double, std::milli>(end - begin).count()
+              << " ms\n";
+    print_stats(alloc);
+}
+
+int main() {
+    size_t n;
+    std::cin >> n;
+    for (size_t threads_num : {1, 2, 4, 8}) {
+        std::cout << threads_num << " threads, " << n << " nodes each:\n";
+        process_sample<std::allocator<int>>(threads_num, n, "Standard allocator");
+        process_sample<StackAllocator<int, SharedMemoryBlocks>>(threads_num, n, "Stack allocator, shared arena");
+        process_sample<StackAllocator<int, ThreadLocalMemoryBlocks>>(threads_num, n, "Stack allocator, thread-local arenas");
+    }
+    return 0;
+}
@@ -1,16 +1,49 @@
-from scipy.interpolate import interp1d
-import matplotlib.pyplot as plt
-import numpy as np
-
-x, y = [], []
-with open("output.txt", "r") as f:
-    for line in f.readlines():
-        line = line.strip().split()
-        x.append(int(line[0]))
-        y.append(float(line[1]))
-
-f = np.poly1d(np.polyfit(x, y, 1))
-
-plt.plot(x, y, 'o', x, f(x), '-')
-
-plt.show()
\ No newline at end of file
+from scipy.interpolate import interp1d
+import matplotlib.pyplot as plt
+import numpy as np
+import csv
+import sys
+
+
+def plot_output(path):
+    x, y = [], []
+    with open(path, "r") as f:
+        for line in f.readlines():
+            line = line.strip().split()
+            x.append(int(line[0]))
+            y.append(float(line[1]))
+
+    f = np.poly1d(np.polyfit(x, y, 1))
+
+    plt.plot(x, y, 'o', x, f(x), '-')
+
+
+# One line per container/allocator pair of the matrix printed by test_matrix.
+def plot_matrix(path, workload, column):
+    lines = {}
+    with open(path, "r") as f:
+        for row in csv.DictReader(f):
+            if row["workload"] != workload:
+                continue
+            key = row["container"] + " / " + row["allocator"]
+            lines.setdefault(key, []).append((int(row["size"]), float(row[column])))
+    for key, points in sorted(lines.items()):
+        points.sort()
+        plt.plot([p[0] for p in points], [p[1] for p in points], 'o-', label=key)
+    plt.xscale("log")
+    plt.xlabel("size")
+    plt.ylabel(column)
+    plt.title(workload)
+    plt.legend(fontsize="small")
+
+
+# python graphic.py                                    plots output.txt
+# python graphic.py matrix.csv [workload] [column]     plots the benchmark matrix
+if len(sys.argv) > 1 and sys.argv[1].endswith(".csv"):
+    workload = sys.argv[2] if len(sys.argv) > 2 else "fifo"
+    column = sys.argv[3] if len(sys.argv) > 3 else "ns_per_op"
+    plot_matrix(sys.argv[1], workload, column)
+else:
+    plot_output(sys.argv[1] if len(sys.argv) > 1 else "output.txt")
+
+plt.show()
@@ -0,0 +1,249 @@
+# include <algorithm>
+# include <cstddef>
+# include <cstdio>
+# include <cstdlib>
+# include <chrono>
+# include <deque>
+# include <iostream>
+# include <iterator>
+# include <list>
+# include <memory>
+# include <new>
+# include <random>
+# include <string>
+# include <vector>
+# include <sys/mman.h>
+# include <sys/resource.h>
+# include <sys/wait.h>
+# include <unistd.h>
+# include "AllocatorManager/MemoryManager.h"
+# include "AllocatorManager/MemoryManager.cpp"
+# include "AllocatorManager/StackAllocator.h"
+# include "XORList/XorList.h"
+# include "XORList/PoolAllocator.h"
+# include "deque.h"
+
+// Every global operator new of a cell passes through here, whichever
+// allocator the container uses, so the count includes arena blocks too.
+class CountingManager : public IMemoryManager
+{
+public:
+    explicit CountingManager(IMemoryManager *inner) : inner_(inner), allocations_(0) {}
+
+    virtual void* Alloc(size_t size) override
+    {
+        ++allocations_;
+        return inner_->Alloc(size);
+    }
+
+    virtual void Free(void *ptr) override
+    {
+        inner_->Free(ptr);
+    }
+
+    size_t allocations() const
+    {
+        return allocations_;
+    }
+private:
+    IMemoryManager *inner_;
+    size_t allocations_;
+};
+
+template<typename T, typename Allocator>
+typename XorList<T, Allocator>::iterator insertAt(XorList<T, Allocator> &c,
+                                                  typename XorList<T, Allocator>::iterator it, const T &value)
+{
+    return c.insert_before(it, value);
+}
+
+template<typename Container>
+typename Container::iterator insertAt(Container &c, typename Container::iterator it,
+                                      const typename Container::value_type &value)
+{
+    return c.insert(it, value);
+}
+
+// Deques have no O(1) insertion in the middle, so they skip the random workload.
+template<typename Container>
+struct IsList : std::false_type {};
+
+template<typename T, typename Allocator>
+struct IsList<XorList<T, Allocator> > : std::true_type {};
+
+template<typename T, typename Allocator>
+struct IsList<std::list<T, Allocator> > : std::true_type {};
+
+// Each workload returns the number of operations it did and folds the values
+// it saw into checksum, so that nothing can be optimized away.
+template<typename Container>
+size_t fifo(Container &c, size_t n, long long &checksum)
+{
+    for (size_t i = 0; i < n; ++i)
+        c.push_back(i);
+    for (size_t i = 0; i < n; ++i)
+    {
+        checksum += *c.begin();
+        c.pop_front();
+        c.push_back(i);
+    }
+    while (!c.empty())
+    {
+        checksum += *c.begin();
+        c.pop_front();
+    }
+    return 4 * n;
+}
+
+template<typename Container>
+size_t lifo(Container &c, size_t n, long long &checksum)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        c.push_back(i);
+        if (i % 3 == 2)
+        {
+            checksum += *std::prev(c.end());
+            c.pop_back();
+        }
+    }
+    while (!c.empty())
+    {
+        checksum += *std::prev(c.end());
+        c.pop_back();
+    }
+    return 2 * n;
+}
+
+template<typename Container>
+size_t randomInsertErase(Container &c, size_t n, long long &checksum, std::true_type)
+{
+    std::mt19937 gen(42);
+    for (size_t i = 0; i < n; ++i)
+        c.push_back(i);
+    typename Container::iterator it = c.begin();
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (unsigned steps = gen() % 8; steps > 0 && it != c.end(); --steps)
+            ++it;
+        if (it == c.end())
+            it = c.begin();
+        if (gen() % 2 || c.size() == 1)
+        {
+            it = insertAt(c, it, static_cast<typename Container::value_type>(i));
+        }
+        else
+        {
+            checksum += *it;
+            it = c.erase(it);
+        }
+    }
+    return 2 * n;
+}
+
+template<typename Container>
+size_t randomInsertErase(Container &, size_t, long long &, std::false_type)
+{
+    return 0;
+}
+
+template<typename Container>
+size_t scan(Container &c, size_t n, long long &checksum)
+{
+    for (size_t i = 0; i < n; ++i)
+        c.push_back(i);
+    for (int pass = 0; pass < 10; ++pass)
+        for (auto x : c)
+            checksum += x;
+    return 11 * n;
+}
+
+template<typename Container>
+size_t runWorkload(const std::string &workload, size_t n, long long &checksum)
+{
+    Container c;
+    if (workload == "fifo")
+        return fifo(c, n, checksum);
+    if (workload == "lifo")
+        return lifo(c, n, checksum);
+    if (workload == "random")
+        return randomInsertErase(c, n, checksum, IsList<Container>());
+    return scan(c, n, checksum);
+}
+
+// Runs the cell in a child process, so that its peak RSS and allocation count
+// are not polluted by the cells before it. The reported RSS is the growth of
+// the peak over what the child inherited.
+template<typename Container>
+void runCell(const std::string &container, const std::string &allocator,
+             const std::string &workload, size_t n, bool managed_stack = false)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long start_rss = usage.ru_maxrss;
+    DefaultManager heap;
+    manager::StackAllocator arena;
+    CountingManager counter(managed_stack ? static_cast<IMemoryManager*>(&arena) : &heap);
+    long long checksum = 0;
+    size_t ops;
+    std::chrono::steady_clock::time_point begin, end;
+    {
+        CMemoryManagerSwitcher switcher(&counter);
+        begin = std::chrono::steady_clock::now();
+        ops = runWorkload<Container>(workload, n, checksum);
+        end = std::chrono::steady_clock::now();
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    if (ops != 0)
+    {
+        std::printf("%s,%s,%s,%zu,%.2f,%ld,%zu,%lld\n", container.c_str(), allocator.c_str(), workload.c_str(), n,
+                    std::chrono::duration<double, std::nano>(end - begin).count() / ops,
+                    usage.ru_maxrss - start_rss, counter.allocations(), checksum);
+    }
+    std::fflush(stdout);
+    _exit(0);
+}
+
+template<template<typename, typename> class Container>
+void runAllocators(const std::string &container, const std::string &workload, size_t n)
+{
+    runCell<Container<int, std::allocator<int> > >(container, "std", workload, n);
+    runCell<Container<int, StackAllocator<int> > >(container, "stack", workload, n);
+    runCell<Container<int, std::allocator<int> > >(container, "manager_stack", workload, n, true);
+    runCell<Container<int, PoolAllocator<int> > >(container, "pool", workload, n);
+}
+
+template<typename T, typename Allocator>
+using StdList = std::list<T, Allocator>;
+
+template<typename T, typename Allocator>
+using StdDeque = std::deque<T, Allocator>;
+
+int main()
+{
+    std::vector<size_t> sizes;
+    size_t n;
+    while (std::cin >> n)
+        sizes.push_back(n);
+    std::printf("container,allocator,workload,size,ns_per_op,peak_rss_kib,allocations,checksum\n");
+    std::fflush(stdout);
+    for (const std::string workload : {"fifo", "lifo", "random", "scan"})
+    {
+        for (size_t size : sizes)
+        {
+            runAllocators<XorList>("XorList", workload, size);
+            runAllocators<StdList>("std::list", workload, size);
+            runAllocators<StdDeque>("std::deque", workload, size);
+            // Deque takes no allocator, it can only be switched at operator new.
+            runCell<Deque<int> >("Deque", "std", workload, size);
+            runCell<Deque<int> >("Deque", "manager_stack", workload, size, true);
+        }
+    }
+    return 0;
+}